@@ -0,0 +1,94 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+// Size of the chunks, allocations larger than that get their own block
+static const size_t CHUNK_SIZE = 256 * 1024;
+
+// Alignment of each allocation, enough for any gcov structure
+static const size_t ALIGNMENT = 16;
+
+// ---------------------------------------------------------------------------
+Arena::Arena()
+   : allocations(0), bytes(0), chunks(0), resets(0), current(0), left(0)
+{
+}
+
+// ---------------------------------------------------------------------------
+Arena::~Arena()
+{
+   Reset();
+   for (size_t ix = 0; ix < spare.size(); ++ix)
+      free(spare[ix]);
+}
+
+// ---------------------------------------------------------------------------
+void* Arena::Alloc(size_t size)
+{
+   size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+   ++allocations;
+   bytes += size;
+
+   if (size > CHUNK_SIZE / 4)
+   {
+      void* block = calloc(1, size);
+      if (!block)
+         throw std::bad_alloc();
+      ++chunks;
+      large.push_back(static_cast< char* >(block));
+      return block;
+   }
+
+   if (size > left)
+   {
+      char* chunk;
+      if (!spare.empty())
+      {
+         chunk = spare.back();
+         spare.pop_back();
+      }
+      else
+      {
+         chunk = static_cast< char* >(malloc(CHUNK_SIZE));
+         if (!chunk)
+            throw std::bad_alloc();
+         ++chunks;
+      }
+      used.push_back(chunk);
+      current = chunk;
+      left = CHUNK_SIZE;
+   }
+
+   void* block = current;
+   memset(block, 0, size);
+   current += size;
+   left -= size;
+   return block;
+}
+
+// ---------------------------------------------------------------------------
+char* Arena::StrDup(const char* string)
+{
+   if (!string)
+      return 0;
+
+   size_t size = strlen(string) + 1;
+   char* copy = static_cast< char* >(Alloc(size));
+   memcpy(copy, string, size);
+   return copy;
+}
+
+// ---------------------------------------------------------------------------
+void Arena::Reset()
+{
+   ++resets;
+   spare.insert(spare.end(), used.begin(), used.end());
+   used.clear();
+   for (size_t ix = 0; ix < large.size(); ++ix)
+      free(large[ix]);
+   large.clear();
+   current = 0;
+   left = 0;
+}
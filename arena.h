@@ -0,0 +1,48 @@
+#ifndef __ARENA_H_INCLUDED__
+#define __ARENA_H_INCLUDED__
+
+#include <stddef.h>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Zeroed memory handed out contiguously from large chunks, and all released
+// at once by Reset. The chunks are kept by Reset, so an arena reused from one
+// object to the next stops calling malloc once it has grown to the largest
+// object.
+class Arena
+{
+public:
+   Arena();
+   ~Arena();
+
+   // SIZE bytes of zeroed memory, valid until the next Reset.
+   void* Alloc(size_t size);
+
+   // Zeroed array of COUNT elements of a POD type.
+   template< class T >
+   T* Alloc(size_t count) { return static_cast< T* >(Alloc(count * sizeof(T))); }
+
+   // Copy of STRING, 0 is copied as 0.
+   char* StrDup(const char* string);
+
+   // Release everything allocated.
+   void Reset();
+
+   // Counters, to compare with one malloc/free per structure
+   unsigned long long allocations; // # of Alloc calls
+   unsigned long long bytes;       // # of bytes handed out
+   unsigned long long chunks;      // # of chunks obtained from malloc
+   unsigned long long resets;      // # of Reset calls
+
+private:
+   Arena(const Arena&);
+   Arena& operator = (const Arena&);
+
+   std::vector< char* > used;  // chunks handed out, the current one last
+   std::vector< char* > spare; // chunks released by Reset
+   std::vector< char* > large; // allocations too large for a chunk, freed by Reset
+   char* current;              // free memory of the current chunk
+   size_t left;                // # of bytes free in the current chunk
+};
+
+#endif
@@ -0,0 +1,345 @@
+#include "binary.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+static
+uint64_t Align(uint64_t offset)
+{
+   return (offset + 7) & ~(uint64_t)7;
+}
+
+// ---------------------------------------------------------------------------
+// Check that the section at OFFSET holds COUNT elements of T, and point
+// COLUMN to it.
+template< class T >
+static
+bool Section(const char* data, size_t size, uint64_t offset, uint64_t count, const T*& column)
+{
+   if (offset > size || count > (size - offset) / sizeof(T) || offset % 8)
+      return false;
+   column = reinterpret_cast< const T* >(data + offset);
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+BinaryCoverage::BinaryCoverage()
+   : function_names(0), function_lines(0), function_hits(0), line_numbers(0), line_counts(0),
+     branch_lines(0), branch_blocks(0), branch_numbers(0), branch_taken(0),
+     header(0), strings(0), sources(0)
+{
+}
+
+// ---------------------------------------------------------------------------
+bool BinaryCoverage::Open(const char* data, size_t size, std::string& error)
+{
+   if (!IsBinaryCoverage(data, size))
+   {
+      error = "not a binary coverage file";
+      return false;
+   }
+   if ((uintptr_t)data % 8)
+   {
+      error = "misaligned data";
+      return false;
+   }
+
+   header = reinterpret_cast< const BinaryHeader* >(data);
+   if (header->version != BINARY_VERSION)
+   {
+      error = "unsupported version";
+      return false;
+   }
+
+   const BinaryHeader& h = *header;
+   if (!Section(data, size, h.strings, h.strings_size, strings)
+       || (h.strings_size && strings[h.strings_size - 1])
+       || !Section(data, size, h.sources, h.num_sources, sources)
+       || !Section(data, size, h.function_names, h.num_functions, function_names)
+       || !Section(data, size, h.function_lines, h.num_functions, function_lines)
+       || !Section(data, size, h.function_hits, h.num_functions, function_hits)
+       || !Section(data, size, h.line_numbers, h.num_lines, line_numbers)
+       || !Section(data, size, h.line_counts, h.num_lines, line_counts)
+       || !Section(data, size, h.branch_lines, h.num_branches, branch_lines)
+       || !Section(data, size, h.branch_blocks, h.num_branches, branch_blocks)
+       || !Section(data, size, h.branch_numbers, h.num_branches, branch_numbers)
+       || !Section(data, size, h.branch_taken, h.num_branches, branch_taken))
+   {
+      error = "truncated or corrupted sections";
+      return false;
+   }
+
+   for (uint64_t ix = 0; ix < h.num_sources; ++ix)
+   {
+      const BinarySource& source = sources[ix];
+      if (source.name >= h.strings_size
+          || source.first_function > h.num_functions || source.num_functions > h.num_functions - source.first_function
+          || source.first_line > h.num_lines || source.num_lines > h.num_lines - source.first_line
+          || source.first_branch > h.num_branches || source.num_branches > h.num_branches - source.first_branch)
+      {
+         error = "corrupted source table";
+         return false;
+      }
+   }
+   for (uint64_t ix = 0; ix < h.num_functions; ++ix)
+      if (function_names[ix] >= h.strings_size)
+      {
+         error = "corrupted function table";
+         return false;
+      }
+   for (uint64_t ix = 0; ix < h.num_lines; ++ix)
+      if (line_numbers[ix] > MAX_LINE_NUMBER)
+      {
+         error = "corrupted line table";
+         return false;
+      }
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+bool IsBinaryCoverage(const char* data, size_t size)
+{
+   uint32_t magic;
+   if (size < sizeof(BinaryHeader))
+      return false;
+   memcpy(&magic, data, sizeof(magic));
+   return magic == BINARY_MAGIC;
+}
+
+// ---------------------------------------------------------------------------
+// Append the bytes of COLUMN to OUT, and pad to 8 bytes
+template< class T >
+static
+void Append(std::string& out, const std::vector< T >& column)
+{
+   if (!column.empty())
+      out.append(reinterpret_cast< const char* >(&column[0]), column.size() * sizeof(T));
+   out.resize(Align(out.size()), '\0');
+}
+
+// ---------------------------------------------------------------------------
+// Binary coverage file of the COVERAGES of the sources IDS, in that order,
+// into OUT. Returns false if it is too large.
+static
+bool Encode(const std::vector< SourceId >& ids, const std::vector< const SourceCoverage* >& coverages, std::string& out)
+{
+   // String table, each function name once
+   std::string strings;
+   std::unordered_map< SymbolId, uint32_t > symbolOffsets;
+   std::vector< BinarySource > sources(ids.size());
+   std::vector< uint32_t > functionNames;
+   std::vector< int32_t > functionLines;
+   std::vector< int64_t > functionHits;
+   std::vector< uint32_t > lineNumbers;
+   std::vector< int64_t > lineCounts;
+   std::vector< int32_t > branchLines, branchBlocks, branchNumbers;
+   std::vector< int64_t > branchTaken;
+
+   for (size_t ix = 0; ix < ids.size(); ++ix)
+   {
+      const SourceCoverage& coverage = *coverages[ix];
+      BinarySource& source = sources[ix];
+      memset(&source, 0, sizeof(source));
+
+      source.name = strings.size();
+      strings += SourceNames.Name(ids[ix]);
+      strings += '\0';
+
+      // Functions in the order of their demangled names, as in a tracefile
+      typedef std::pair< const std::string*, Functions::const_iterator > NamedFunction;
+      std::vector< NamedFunction > named;
+      for (Functions::const_iterator function = coverage.functions.begin(); function != coverage.functions.end(); ++function)
+         named.push_back(NamedFunction(&FunctionNames.Name(function->first), function));
+      std::sort(named.begin(), named.end(), [](const NamedFunction& lhs, const NamedFunction& rhs) { return *lhs.first < *rhs.first; });
+
+      source.first_function = functionNames.size();
+      source.num_functions = named.size();
+      for (size_t jx = 0; jx < named.size(); ++jx)
+      {
+         std::pair< std::unordered_map< SymbolId, uint32_t >::iterator, bool > inserted = symbolOffsets.insert(std::make_pair(named[jx].second->first, 0));
+         uint32_t& offset = inserted.first->second;
+         if (inserted.second)
+         {
+            offset = strings.size();
+            strings += *named[jx].first;
+            strings += '\0';
+         }
+         functionNames.push_back(offset);
+         functionLines.push_back(named[jx].second->second.line);
+         functionHits.push_back(named[jx].second->second.hit);
+      }
+
+      source.first_line = lineNumbers.size();
+      for (size_t line = 0; line < coverage.lines.size(); ++line)
+         if (coverage.lines[line] != NO_LINE)
+         {
+            lineNumbers.push_back(line);
+            lineCounts.push_back(coverage.lines[line]);
+         }
+      source.num_lines = lineNumbers.size() - source.first_line;
+
+      source.first_branch = branchLines.size();
+      source.num_branches = coverage.branches.size();
+      for (Branches::const_iterator branch = coverage.branches.begin(); branch != coverage.branches.end(); ++branch)
+      {
+         branchLines.push_back(branch->id.line);
+         branchBlocks.push_back(branch->id.block);
+         branchNumbers.push_back(branch->id.branch);
+         branchTaken.push_back(branch->taken);
+      }
+   }
+   if (strings.size() > 0xffffffffULL)
+      return false;
+
+   // Layout
+   BinaryHeader header;
+   memset(&header, 0, sizeof(header));
+   header.magic = BINARY_MAGIC;
+   header.version = BINARY_VERSION;
+   header.num_sources = sources.size();
+   header.num_functions = functionNames.size();
+   header.num_lines = lineNumbers.size();
+   header.num_branches = branchLines.size();
+   header.strings_size = strings.size();
+
+   uint64_t offset = Align(sizeof(header));
+   header.strings = offset;        offset = Align(offset + strings.size());
+   header.sources = offset;        offset = Align(offset + sources.size() * sizeof(BinarySource));
+   header.function_names = offset; offset = Align(offset + functionNames.size() * sizeof(uint32_t));
+   header.function_lines = offset; offset = Align(offset + functionLines.size() * sizeof(int32_t));
+   header.function_hits = offset;  offset = Align(offset + functionHits.size() * sizeof(int64_t));
+   header.line_numbers = offset;   offset = Align(offset + lineNumbers.size() * sizeof(uint32_t));
+   header.line_counts = offset;    offset = Align(offset + lineCounts.size() * sizeof(int64_t));
+   header.branch_lines = offset;   offset = Align(offset + branchLines.size() * sizeof(int32_t));
+   header.branch_blocks = offset;  offset = Align(offset + branchBlocks.size() * sizeof(int32_t));
+   header.branch_numbers = offset; offset = Align(offset + branchNumbers.size() * sizeof(int32_t));
+   header.branch_taken = offset;   offset = Align(offset + branchTaken.size() * sizeof(int64_t));
+
+   out.clear();
+   out.reserve(offset);
+   out.append(reinterpret_cast< const char* >(&header), sizeof(header));
+   out.resize(Align(out.size()), '\0');
+   out += strings;
+   out.resize(Align(out.size()), '\0');
+   Append(out, sources);
+   Append(out, functionNames);
+   Append(out, functionLines);
+   Append(out, functionHits);
+   Append(out, lineNumbers);
+   Append(out, lineCounts);
+   Append(out, branchLines);
+   Append(out, branchBlocks);
+   Append(out, branchNumbers);
+   Append(out, branchTaken);
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+bool WriteBinary(const std::string& filename, unsigned& written)
+{
+   // Sources in the order of their names
+   std::vector< SourceId > ids = SourceNames.SortedIds();
+   ids.erase(std::remove_if(ids.begin(), ids.end(), [](SourceId id) { return id >= Coverage.size() || !Coverage[id].found; }), ids.end());
+   written = ids.size();
+
+   std::vector< const SourceCoverage* > coverages(ids.size());
+   for (size_t ix = 0; ix < ids.size(); ++ix)
+      coverages[ix] = &Coverage[ ids[ix] ];
+   std::string out;
+   if (!Encode(ids, coverages, out))
+      return false;
+
+   FILE* file = stdout;
+   if (filename == "-")
+   {
+      fflush(stdout);
+#ifdef WIN32
+      _setmode(_fileno(stdout), _O_BINARY);
+#endif
+   }
+   else if (!(file = fopen(filename.c_str(), "wb")))
+      return false;
+   setvbuf(file, NULL, _IONBF, 0);
+
+   bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+   if (file == stdout ? fflush(file) != 0 : fclose(file) != 0)
+      ok = false;
+   return ok;
+}
+
+// ---------------------------------------------------------------------------
+bool EncodeBinary(const SourceInfos& infos, std::string& out)
+{
+   std::vector< SourceId > ids;
+   std::vector< const SourceCoverage* > coverages;
+   for (size_t ix = 0; ix < infos.sources.size(); ++ix)
+      if (infos.sources[ix].second.found)
+      {
+         ids.push_back(infos.sources[ix].first);
+         coverages.push_back(&infos.sources[ix].second);
+      }
+   return Encode(ids, coverages, out);
+}
+
+// ---------------------------------------------------------------------------
+void LoadBinary(const BinaryCoverage& binary, SourceInfos& infos)
+{
+   const BinaryHeader& header = binary.Header();
+
+   // Ids of the function names, by offset in the string table
+   std::unordered_map< uint32_t, SymbolId > symbols;
+
+   for (uint64_t ix = 0; ix < header.num_sources; ++ix)
+   {
+      const BinarySource& source = binary.Sources()[ix];
+
+      SourceId id = SourceNames.Intern(std::string(), binary.String(source.name));
+      if (SourceNames.Excluded(id))
+         continue;
+      infos.sources.push_back(std::make_pair(id, SourceCoverage()));
+      SourceCoverage& coverage = infos.sources.back().second;
+      coverage.found = true;
+
+      for (uint64_t jx = source.first_function; jx < source.first_function + source.num_functions; ++jx)
+      {
+         std::pair< std::unordered_map< uint32_t, SymbolId >::iterator, bool > inserted = symbols.insert(std::make_pair(binary.function_names[jx], 0));
+         if (inserted.second)
+            inserted.first->second = FunctionNames.InternName(binary.String(binary.function_names[jx]));
+
+         FunctionInfo& function = coverage.functions[ inserted.first->second ];
+         function.line = binary.function_lines[jx];
+         function.hit += binary.function_hits[jx];
+      }
+
+      if (source.num_lines)
+         coverage.lines.assign(binary.line_numbers[ source.first_line + source.num_lines - 1 ] + 1, NO_LINE);
+      for (uint64_t jx = source.first_line; jx < source.first_line + source.num_lines; ++jx)
+      {
+         uint32_t line = binary.line_numbers[jx];
+         if (line >= coverage.lines.size())
+            coverage.lines.resize(line + 1, NO_LINE);
+         if (coverage.lines[line] == NO_LINE) coverage.lines[line] = binary.line_counts[jx];
+         else coverage.lines[line] += binary.line_counts[jx];
+      }
+
+      coverage.branches.resize(source.num_branches);
+      for (uint64_t jx = 0; jx < source.num_branches; ++jx)
+      {
+         BranchInfo& branch = coverage.branches[jx];
+         branch.id.line = binary.branch_lines[ source.first_branch + jx ];
+         branch.id.block = binary.branch_blocks[ source.first_branch + jx ];
+         branch.id.branch = binary.branch_numbers[ source.first_branch + jx ];
+         branch.taken = binary.branch_taken[ source.first_branch + jx ];
+      }
+      SortBranches(coverage.branches);
+   }
+}
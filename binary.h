@@ -0,0 +1,117 @@
+#ifndef __BINARY_H_INCLUDED__
+#define __BINARY_H_INCLUDED__
+
+#include "coverage.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// ---------------------------------------------------------------------------
+// Binary coverage file: the content of a tracefile as columns, which can be
+// used straight from a mapping. All the sections are 8 byte aligned arrays,
+// in the byte order of the writer (checked by the magic number).
+//
+//   header
+//   strings          NUL terminated source and function names, each once
+//   sources          BinarySource[num_sources], sorted by name (in the order
+//                    of the partial infos for EncodeBinary)
+//   function_names   uint32_t[num_functions], offsets in strings
+//   function_lines   int32_t[num_functions]
+//   function_hits    int64_t[num_functions]
+//   line_numbers     uint32_t[num_lines]
+//   line_counts      int64_t[num_lines]
+//   branch_lines     int32_t[num_branches]
+//   branch_blocks    int32_t[num_branches]
+//   branch_numbers   int32_t[num_branches]
+//   branch_taken     int64_t[num_branches], -1 if never executed
+//
+// The functions, lines and branches of a source are contiguous, in the
+// order of the tracefile.
+const uint32_t BINARY_MAGIC = 0x62766f63; // "covb"
+const uint32_t BINARY_VERSION = 1;
+
+struct BinaryHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t num_sources;
+   uint64_t num_functions;
+   uint64_t num_lines;
+   uint64_t num_branches;
+   uint64_t strings_size;
+
+   // Offsets of the sections from the start of the file
+   uint64_t strings;
+   uint64_t sources;
+   uint64_t function_names;
+   uint64_t function_lines;
+   uint64_t function_hits;
+   uint64_t line_numbers;
+   uint64_t line_counts;
+   uint64_t branch_lines;
+   uint64_t branch_blocks;
+   uint64_t branch_numbers;
+   uint64_t branch_taken;
+};
+
+struct BinarySource
+{
+   uint32_t name;       // offset in strings
+   uint32_t reserved;
+   uint64_t first_function;
+   uint64_t num_functions;
+   uint64_t first_line;
+   uint64_t num_lines;
+   uint64_t first_branch;
+   uint64_t num_branches;
+};
+
+// ---------------------------------------------------------------------------
+// Checked view of a binary coverage file in memory
+class BinaryCoverage
+{
+public:
+   BinaryCoverage();
+
+   // Check DATA of SIZE bytes, false if it is not a valid binary coverage
+   // file, described in ERROR.
+   bool Open(const char* data, size_t size, std::string& error);
+
+   const BinaryHeader& Header() const { return *header; }
+   const BinarySource* Sources() const { return sources; }
+   const char* String(uint32_t offset) const { return strings + offset; }
+
+   // Columns
+   const uint32_t* function_names;
+   const int32_t* function_lines;
+   const int64_t* function_hits;
+   const uint32_t* line_numbers;
+   const int64_t* line_counts;
+   const int32_t* branch_lines;
+   const int32_t* branch_blocks;
+   const int32_t* branch_numbers;
+   const int64_t* branch_taken;
+
+private:
+   const BinaryHeader* header;
+   const char* strings;
+   const BinarySource* sources;
+};
+
+// true if DATA starts like a binary coverage file
+bool IsBinaryCoverage(const char* data, size_t size);
+
+// Write the Coverage aggregate to FILENAME (- for stdout) as a binary
+// coverage file. SOURCES gets the # of sources written. Returns false on
+// error.
+bool WriteBinary(const std::string& filename, unsigned& sources);
+
+// Binary coverage file of the partial INFOS, their sources in the same order,
+// into OUT. Returns false if it is too large.
+bool EncodeBinary(const SourceInfos& infos, std::string& out);
+
+// Add the content of COVERAGE to INFOS
+void LoadBinary(const BinaryCoverage& coverage, SourceInfos& infos);
+
+#endif
@@ -0,0 +1,106 @@
+#include "coverage.h"
+
+#include <algorithm>
+
+SourceTable SourceNames;
+SymbolTable FunctionNames;
+std::vector< SourceCoverage > Coverage;
+
+// ---------------------------------------------------------------------------
+static
+void AddTaken(long long& into, long long taken)
+{
+   // A branch never executed ('-') is overridden by any count
+   if (taken >= 0)
+   {
+      if (into < 0) into = taken;
+      else into += taken;
+   }
+}
+
+// ---------------------------------------------------------------------------
+void SortBranches(Branches& branches)
+{
+   std::stable_sort(branches.begin(), branches.end(), [](const BranchInfo& lhs, const BranchInfo& rhs) { return lhs.id < rhs.id; });
+
+   Branches::iterator last = branches.begin();
+   for (Branches::iterator it = branches.begin(); it != branches.end(); ++it)
+   {
+      if (it == last)
+         continue;
+      if (!(it->id == last->id))
+         *++last = *it;
+      else
+         AddTaken(last->taken, it->taken);
+   }
+   if (!branches.empty())
+      branches.erase(last + 1, branches.end());
+}
+
+// ---------------------------------------------------------------------------
+void MergeCoverage(SourceCoverage& into, const SourceCoverage& from)
+{
+   into.found = true;
+
+   for (Functions::const_iterator function = from.functions.begin(); function != from.functions.end(); ++function)
+   {
+      FunctionInfo& info = into.functions[ function->first ];
+      info.line = function->second.line;
+      info.hit += function->second.hit;
+   }
+
+   // Lines, as a vector add
+   if (into.lines.size() < from.lines.size())
+      into.lines.resize(from.lines.size(), NO_LINE);
+   for (size_t line = 0; line < from.lines.size(); ++line)
+   {
+      if (from.lines[line] == NO_LINE)
+         continue;
+      if (into.lines[line] == NO_LINE) into.lines[line] = from.lines[line];
+      else into.lines[line] += from.lines[line];
+   }
+
+   // Branches, both sorted: in place when INTO has all the branches of
+   // FROM, which is the usual case of a header seen again, else by a merge.
+   Branches::iterator it = into.branches.begin();
+   Branches::const_iterator jt = from.branches.begin();
+   for (; jt != from.branches.end(); ++it, ++jt)
+   {
+      it = std::lower_bound(it, into.branches.end(), *jt, [](const BranchInfo& lhs, const BranchInfo& rhs) { return lhs.id < rhs.id; });
+      if (it == into.branches.end() || !(it->id == jt->id))
+         break;
+      AddTaken(it->taken, jt->taken);
+   }
+   if (jt == from.branches.end())
+      return;
+
+   Branches merged;
+   merged.reserve(into.branches.size() + (from.branches.end() - jt));
+   Branches::const_iterator left = into.branches.begin();
+   for (; jt != from.branches.end(); ++jt)
+   {
+      for (; left != into.branches.end() && left->id < jt->id; ++left)
+         merged.push_back(*left);
+      if (left != into.branches.end() && left->id == jt->id)
+      {
+         merged.push_back(*left++);
+         AddTaken(merged.back().taken, jt->taken);
+      }
+      else
+         merged.push_back(*jt);
+   }
+   merged.insert(merged.end(), left, Branches::const_iterator(into.branches.end()));
+   into.branches.swap(merged);
+}
+
+// ---------------------------------------------------------------------------
+void MergeInfos(const SourceInfos& infos)
+{
+   for (size_t ix = 0; ix < infos.sources.size(); ++ix)
+   {
+      SourceId id = infos.sources[ix].first;
+      if (id >= Coverage.size())
+         Coverage.resize(id + 1);
+      MergeCoverage(Coverage[ id ], infos.sources[ix].second);
+   }
+}
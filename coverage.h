@@ -0,0 +1,113 @@
+#ifndef __COVERAGE_H_INCLUDED__
+#define __COVERAGE_H_INCLUDED__
+
+#include "sourcetable.h"
+#include "demangle.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+struct FunctionInfo
+{
+   FunctionInfo() : line(0), hit(0) {}
+
+   int line;      // line of the source code
+   long long hit; // # of executed
+};
+
+// ---------------------------------------------------------------------------
+struct BranchId
+{
+   BranchId() : line(0), block(0), branch(0) {}
+   int line;
+   int block;
+   int branch;
+};
+
+// ---------------------------------------------------------------------------
+inline
+bool operator < (const BranchId& lhs, const BranchId& rhs)
+{
+   if (lhs.line < rhs.line) return true;
+   if (lhs.line > rhs.line) return false;
+   if (lhs.block < rhs.block) return true;
+   if (lhs.block > rhs.block) return false;
+   if (lhs.branch < rhs.branch) return true;
+   if (lhs.branch > rhs.branch) return false;
+   return false;
+}
+
+// ---------------------------------------------------------------------------
+inline
+bool operator == (const BranchId& lhs, const BranchId& rhs)
+{
+   return lhs.line == rhs.line && lhs.block == rhs.block && lhs.branch == rhs.branch;
+}
+
+// ---------------------------------------------------------------------------
+struct BranchInfo
+{
+   BranchInfo() : taken(-1) {}
+
+   BranchId id;
+   long long taken; // # of times taken, -1 if never executed ('-')
+};
+
+// ---------------------------------------------------------------------------
+// Count of the lines which are not instrumented
+const long long NO_LINE = (-9223372036854775807LL - 1);
+
+// Function informations, by demangled name
+typedef std::map< SymbolId, FunctionInfo > Functions;
+// Line execution count, by line number, NO_LINE if not instrumented
+typedef std::vector< long long > Lines;
+
+// Largest line number read from a tracefile or binary coverage file. The
+// line counts are indexed by line number, so a larger one, from a corrupted
+// file, would allocate gigabytes.
+const long long MAX_LINE_NUMBER = 1 << 24;
+// Branch execution count, sorted by id
+typedef std::vector< BranchInfo > Branches;
+
+// ---------------------------------------------------------------------------
+// Coverage of one source file
+struct SourceCoverage
+{
+   SourceCoverage() : found(false) {}
+
+   bool found;         // false until some object has infos for it
+   Functions functions;
+   Lines lines;
+   Branches branches;
+};
+
+// Names of the sources
+extern SourceTable SourceNames;
+// Demangled names of the functions
+extern SymbolTable FunctionNames;
+
+// Storing infos by SourceId
+extern std::vector< SourceCoverage > Coverage;
+
+// ---------------------------------------------------------------------------
+// Partial infos by source, as built by one capture worker for one object
+struct SourceInfos
+{
+   std::vector< std::pair< SourceId, SourceCoverage > > sources;
+};
+
+// Sort BRANCHES by id, adding the counts of a branch found twice.
+void SortBranches(Branches& branches);
+
+// Add the coverage FROM to INTO: the function lines are overridden, all the
+// counts are added, and a branch never executed is overridden by any count.
+void MergeCoverage(SourceCoverage& into, const SourceCoverage& from);
+
+// Add partial infos to the global ones. Merging the partials in the
+// order of the objects gives the same result as a serial capture.
+void MergeInfos(const SourceInfos& infos);
+
+#endif
@@ -1,3 +1,5 @@
+#include "demangle.h"
+
 #include <string>
 
 #ifndef WIN32
@@ -22,3 +24,61 @@ std::string Demangled(const std::string& functionName)
 #endif
    return realName;
 }
+
+// ---------------------------------------------------------------------------
+SymbolTable::SymbolTable()
+   : lookups(0), misses(0)
+{
+}
+
+// ---------------------------------------------------------------------------
+SymbolId SymbolTable::Intern(const char* mangled)
+{
+   // The key buffer of each thread keeps its capacity from one call to the next
+   static thread_local std::string key;
+   key.assign(mangled);
+   ++lookups;
+
+   Shard& shard = shards[ std::hash< std::string >()(key) % SHARDS ];
+   {
+      std::lock_guard< std::mutex > lock(shard.mutex);
+      std::unordered_map< std::string, SymbolId >::const_iterator found = shard.mangled.find(key);
+      if (found != shard.mangled.end())
+         return found->second;
+   }
+
+   // Demangle without holding any lock
+   std::string name = Demangled(key);
+
+   SymbolId id = InternName(name);
+
+   std::lock_guard< std::mutex > lock(shard.mutex);
+   if (shard.mangled.insert(std::make_pair(key, id)).second)
+      ++misses;
+   return id;
+}
+
+// ---------------------------------------------------------------------------
+SymbolId SymbolTable::InternName(const std::string& name)
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   std::pair< std::unordered_map< std::string, SymbolId >::iterator, bool > inserted =
+      demangled.insert(std::make_pair(name, (SymbolId)names.size()));
+   if (inserted.second)
+      names.push_back(name);
+   return inserted.first->second;
+}
+
+// ---------------------------------------------------------------------------
+const std::string& SymbolTable::Name(SymbolId id) const
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   return names[ id ];
+}
+
+// ---------------------------------------------------------------------------
+size_t SymbolTable::Size() const
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   return names.size();
+}
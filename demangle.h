@@ -1,8 +1,60 @@
 #ifndef __DEMANGLE_H_INCLUDED__
 #define __DEMANGLE_H_INCLUDED__
 
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 std::string Demangled(const std::string& functionName);
 
+// Identity of a demangled function name
+typedef unsigned SymbolId;
+
+// ---------------------------------------------------------------------------
+// Process-wide cache of the demangled function names. Each mangled name is
+// demangled once, the first time it is seen, and the demangled names are
+// interned, so that two mangled names with the same demangling (all the
+// names which can't be demangled give "") get the same id. The mangled
+// names are spread over several locks, to keep the capture workers from
+// waiting on each other.
+class SymbolTable
+{
+public:
+   SymbolTable();
+
+   // Id of the demangled name of MANGLED
+   SymbolId Intern(const char* mangled);
+
+   // Id of NAME, already demangled (e.g. read from a tracefile)
+   SymbolId InternName(const std::string& name);
+
+   // Demangled name of ID, valid for the life of the table.
+   const std::string& Name(SymbolId id) const;
+
+   // Counters
+   std::atomic< unsigned long long > lookups; // # of Intern calls
+   std::atomic< unsigned long long > misses;  // # of demangled names
+
+   // # of distinct demangled names
+   size_t Size() const;
+
+private:
+   SymbolTable(const SymbolTable&);
+   SymbolTable& operator = (const SymbolTable&);
+
+   enum { SHARDS = 16 };
+   struct Shard
+   {
+      std::mutex mutex;
+      std::unordered_map< std::string, SymbolId > mangled;
+   };
+   Shard shards[ SHARDS ];
+
+   mutable std::mutex mutex;                                // for demangled and names
+   std::unordered_map< std::string, SymbolId > demangled;  // demangled name -> id
+   std::deque< std::string > names;                         // demangled name by id
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "filter.h"
+#include "sourcetable.h"
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Current directory, with a trailing '/'
+static
+std::string CurrentDirectory()
+{
+   char buffer[ 4096 ];
+#ifdef WIN32
+   if (!_getcwd(buffer, sizeof(buffer)))
+#else
+   if (!getcwd(buffer, sizeof(buffer)))
+#endif
+      return "/";
+   std::string directory = SourceTable::Normalize(buffer);
+   if (directory.empty() || directory[directory.size() - 1] != '/')
+      directory += '/';
+   return directory;
+}
+
+// ---------------------------------------------------------------------------
+void SourceFilter::Include(const std::string& pattern)
+{
+   includes.push_back(pattern);
+}
+
+// ---------------------------------------------------------------------------
+void SourceFilter::Exclude(const std::string& pattern)
+{
+   excludes.push_back(pattern);
+}
+
+// ---------------------------------------------------------------------------
+void SourceFilter::Internal(const std::string& directory)
+{
+   // As lcov, absolute paths are compared: the sources may be recorded with
+   // absolute paths (as by CMake) when the directory is relative
+   current = CurrentDirectory();
+   std::string normalized = SourceTable::Normalize(directory[0] == '/' ? directory : current + directory);
+   if (normalized[normalized.size() - 1] != '/')
+      normalized += '/';
+   directories.push_back(normalized);
+}
+
+// ---------------------------------------------------------------------------
+bool SourceFilter::Empty() const
+{
+   return includes.empty() && excludes.empty() && directories.empty();
+}
+
+// ---------------------------------------------------------------------------
+std::string SourceFilter::Key() const
+{
+   std::string key;
+   for (size_t ix = 0; ix < includes.size(); ++ix)
+      key += "+" + includes[ix] + '\n';
+   for (size_t ix = 0; ix < excludes.size(); ++ix)
+      key += "-" + excludes[ix] + '\n';
+   for (size_t ix = 0; ix < directories.size(); ++ix)
+      key += "=" + directories[ix] + '\n';
+   return key;
+}
+
+// ---------------------------------------------------------------------------
+bool SourceFilter::Excluded(const std::string& path) const
+{
+   if (!directories.empty())
+   {
+      const std::string absolute = path[0] == '/' ? path : SourceTable::Normalize(current + path);
+      bool internal = false;
+      for (size_t ix = 0; ix < directories.size() && !internal; ++ix)
+         internal = !absolute.compare(0, directories[ix].size(), directories[ix]);
+      if (!internal)
+         return true;
+   }
+
+   if (!includes.empty())
+   {
+      bool included = false;
+      for (size_t ix = 0; ix < includes.size() && !included; ++ix)
+         included = Match(includes[ix].c_str(), path.c_str());
+      if (!included)
+         return true;
+   }
+
+   for (size_t ix = 0; ix < excludes.size(); ++ix)
+      if (Match(excludes[ix].c_str(), path.c_str()))
+         return true;
+   return false;
+}
+
+// ---------------------------------------------------------------------------
+bool SourceFilter::Match(const char* pattern, const char* text)
+{
+   // Greedy match, going back to the last '*' on a mismatch
+   const char* star = 0;     // last '*' of the pattern
+   const char* restart = 0;  // where the text matched by that '*' ends
+   while (*text)
+   {
+      if (*pattern == '*')
+      {
+         star = pattern++;
+         restart = text;
+      }
+      else if (*pattern == '?' || *pattern == *text)
+      {
+         ++pattern;
+         ++text;
+      }
+      else if (star)
+      {
+         pattern = star + 1;
+         text = ++restart;
+      }
+      else
+         return false;
+   }
+   while (*pattern == '*')
+      ++pattern;
+   return !*pattern;
+}
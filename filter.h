@@ -0,0 +1,44 @@
+#ifndef __FILTER_H_INCLUDED__
+#define __FILTER_H_INCLUDED__
+
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Selection of the source files by glob patterns, as lcov --extract and
+// --remove, and by directory, as lcov --no-external. In the patterns, '*'
+// matches any sequence of characters, '/' included, and '?' any one
+// character. The paths and directories are normalized ones; the relative
+// ones are taken from the current directory when an internal directory
+// is added, for --no-external.
+class SourceFilter
+{
+public:
+   // Keep only the sources matching one of the included patterns
+   void Include(const std::string& pattern);
+   // Drop the sources matching one of the excluded patterns
+   void Exclude(const std::string& pattern);
+   // Drop the sources outside of all the internal directories
+   void Internal(const std::string& directory);
+
+   // true if there is nothing to filter
+   bool Empty() const;
+
+   // true if the source PATH is filtered out
+   bool Excluded(const std::string& path) const;
+
+   // Patterns and directories of the filter, equal for the filters which
+   // select the same sources
+   std::string Key() const;
+
+   // true if TEXT matches the glob PATTERN
+   static bool Match(const char* pattern, const char* text);
+
+private:
+   std::vector< std::string > includes;
+   std::vector< std::string > excludes;
+   std::vector< std::string > directories; // absolute, with a trailing '/'
+   std::string current;                    // directory of the relative paths
+};
+
+#endif
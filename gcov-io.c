@@ -28,15 +28,16 @@ Software Foundation, 51 Franklin Street, Fifth Floor, Boston, MA
 static void gcov_write_block (unsigned);
 static gcov_unsigned_t *gcov_write_words (unsigned);
 #endif
-static const gcov_unsigned_t *gcov_read_words (unsigned);
+static const gcov_unsigned_t *gcov_read_words (struct gcov_var *, unsigned);
 #if !IN_LIBGCOV
-static void gcov_allocate (unsigned);
+static void gcov_allocate (struct gcov_var *, unsigned);
 #endif
 
-static inline gcov_unsigned_t from_file (gcov_unsigned_t value)
+static inline gcov_unsigned_t from_file (const struct gcov_var *var,
+				       gcov_unsigned_t value)
 {
 #if !IN_LIBGCOV
-  if (gcov_var.endian)
+  if (var->endian)
     {
       value = (value >> 16) | (value << 16);
       value = ((value & 0xff00ff) << 8) | ((value >> 8) & 0xff00ff);
@@ -51,17 +52,20 @@ static inline gcov_unsigned_t from_file (gcov_unsigned_t value)
    opened, if possible, and if MODE is <= 0, a new file will be
    created. Use MODE=0 to attempt to reopen an existing file and then
    fall back on creating a new one.  Return zero on failure, >0 on
-   opening an existing file and <0 on creating a new one.  */
+   opening an existing file and <0 on creating a new one.  Outside
+   libgcov, the file is opened in VAR, which must have been zeroed
+   or closed before.  */
 
 GCOV_LINKAGE int
 #if IN_LIBGCOV
 gcov_open (const char *name)
 #else
-gcov_open (const char *name, int mode)
+gcov_open_r (struct gcov_var *var, const char *name, int mode)
 #endif
 {
 #if IN_LIBGCOV
   const int mode = 0;
+  struct gcov_var *const var = &gcov_var;
 #endif
 #if GCOV_LOCKED
   struct flock s_flock;
@@ -74,13 +78,45 @@ gcov_open (const char *name, int mode)
   s_flock.l_pid = getpid ();
 #endif
   
-  gcc_assert (!gcov_var.file);
-  gcov_var.start = 0;
-  gcov_var.offset = gcov_var.length = 0;
-  gcov_var.overread = -1u;
-  gcov_var.error = 0;
+  gcc_assert (!var->file);
+  var->start = 0;
+  var->offset = var->length = 0;
+  var->overread = -1u;
+  var->error = 0;
 #if !IN_LIBGCOV
-  gcov_var.endian = 0;
+  var->endian = 0;
+#endif
+#if GCOV_MMAP
+  var->map = 0;
+  if (mode > 0 && gcov_mmap_enabled)
+    {
+      struct stat st;
+      int fd = open (name, O_RDONLY);
+
+      if (fd < 0)
+	return 0;
+      if (fstat (fd, &st) == 0 && st.st_size > 0)
+	{
+	  void *map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	  if (map != MAP_FAILED)
+	    {
+	      /* The whole file is read once, from start to end.  */
+	      madvise (map, st.st_size, MADV_SEQUENTIAL);
+	      madvise (map, st.st_size, MADV_WILLNEED);
+	      close (fd);
+
+	      var->map = (const gcov_unsigned_t *) map;
+	      var->map_size = st.st_size;
+	      var->mtime = st.st_mtime;
+	      var->length = st.st_size >> 2;
+	      var->mode = 1;
+	      return 1;
+	    }
+	}
+      /* Empty or unmappable file, read it with stdio.  */
+      close (fd);
+    }
 #endif
 #if GCOV_LOCKED
   if (mode > 0)
@@ -93,48 +129,48 @@ gcov_open (const char *name, int mode)
   while (fcntl (fd, F_SETLKW, &s_flock) && errno == EINTR)
     continue;
 
-  gcov_var.file = fdopen (fd, "r+b");
-  if (!gcov_var.file)
+  var->file = fdopen (fd, "r+b");
+  if (!var->file)
     {
       close (fd);
       return 0;
     }
 
   if (mode > 0)
-    gcov_var.mode = 1;
+    var->mode = 1;
   else if (mode == 0)
     {
       struct stat st;
 
       if (fstat (fd, &st) < 0)
 	{
-	  fclose (gcov_var.file);
-	  gcov_var.file = 0;
+	  fclose (var->file);
+	  var->file = 0;
 	  return 0;
 	}
       if (st.st_size != 0)
-	gcov_var.mode = 1;
+	var->mode = 1;
       else
-	gcov_var.mode = mode * 2 + 1;
+	var->mode = mode * 2 + 1;
     }
   else
-    gcov_var.mode = mode * 2 + 1;
+    var->mode = mode * 2 + 1;
 #else
   if (mode >= 0)
-    gcov_var.file = fopen (name, "r+b");
-  if (gcov_var.file)
-    gcov_var.mode = 1;
+    var->file = fopen (name, "r+b");
+  if (var->file)
+    var->mode = 1;
   else if (mode <= 0)
     {
-      gcov_var.file = fopen (name, "w+b");
-      if (gcov_var.file)
-	gcov_var.mode = mode * 2 + 1;
+      var->file = fopen (name, "w+b");
+      if (var->file)
+	var->mode = mode * 2 + 1;
     }
-  if (!gcov_var.file)
+  if (!var->file)
     return 0;
 #endif
 
-  setbuf (gcov_var.file, (char *)0);
+  setbuf (var->file, (char *)0);
   
   return 1;
 }
@@ -143,26 +179,42 @@ gcov_open (const char *name, int mode)
    on failure or error flag set.  */
 
 GCOV_LINKAGE int
-gcov_close (void)
+gcov_close_r (struct gcov_var *var)
 {
-  if (gcov_var.file)
+#if GCOV_MMAP
+  if (var->map)
+    {
+      munmap ((void *) var->map, var->map_size);
+      var->map = 0;
+      var->length = 0;
+    }
+#endif
+  if (var->file)
     {
 #if !IN_GCOV
-      if (gcov_var.offset && gcov_var.mode < 0)
-	gcov_write_block (gcov_var.offset);
+      if (var->offset && var->mode < 0)
+	gcov_write_block (var->offset);
 #endif
-      fclose (gcov_var.file);
-      gcov_var.file = 0;
-      gcov_var.length = 0;
+      fclose (var->file);
+      var->file = 0;
+      var->length = 0;
     }
 #if !IN_LIBGCOV
-  free (gcov_var.buffer);
-  gcov_var.alloc = 0;
-  gcov_var.buffer = 0;
+  free (var->buffer);
+  var->alloc = 0;
+  var->buffer = 0;
 #endif
-  gcov_var.mode = 0;
-  return gcov_var.error;
+  var->mode = 0;
+  return var->error;
+}
+
+#if IN_LIBGCOV
+GCOV_LINKAGE int
+gcov_close (void)
+{
+  return gcov_close_r (&gcov_var);
 }
+#endif
 
 #if !IN_LIBGCOV
 /* Check if MAGIC is EXPECTED. Use it to determine endianness of the
@@ -170,7 +222,8 @@ gcov_close (void)
    not EXPECTED.  */
 
 GCOV_LINKAGE int
-gcov_magic (gcov_unsigned_t magic, gcov_unsigned_t expected)
+gcov_magic_r (struct gcov_var *var, gcov_unsigned_t magic,
+	      gcov_unsigned_t expected)
 {
   if (magic == expected)
     return 1;
@@ -178,7 +231,7 @@ gcov_magic (gcov_unsigned_t magic, gcov_unsigned_t expected)
   magic = ((magic & 0xff00ff) << 8) | ((magic >> 8) & 0xff00ff);
   if (magic == expected)
     {
-      gcov_var.endian = 1;
+      var->endian = 1;
       return -1;
     }
   return 0;
@@ -187,17 +240,17 @@ gcov_magic (gcov_unsigned_t magic, gcov_unsigned_t expected)
 
 #if !IN_LIBGCOV
 static void
-gcov_allocate (unsigned length)
+gcov_allocate (struct gcov_var *var, unsigned length)
 {
-  size_t new_size = gcov_var.alloc;
+  size_t new_size = var->alloc;
   
   if (!new_size)
     new_size = GCOV_BLOCK_SIZE;
   new_size += length;
   new_size *= 2;
   
-  gcov_var.alloc = new_size;
-  gcov_var.buffer = (gcov_unsigned_t*)xrealloc (gcov_var.buffer, new_size << 2);
+  var->alloc = new_size;
+  var->buffer = (gcov_unsigned_t*)xrealloc (var->buffer, new_size << 2);
 }
 #endif
 
@@ -234,7 +287,7 @@ gcov_write_words (unsigned words)
     }
 #else
   if (gcov_var.offset + words > gcov_var.alloc)
-    gcov_allocate (gcov_var.offset + words);
+    gcov_allocate (&gcov_var, gcov_var.offset + words);
 #endif
   result = &gcov_var.buffer[gcov_var.offset];
   gcov_var.offset += words;
@@ -375,46 +428,60 @@ gcov_write_summary (gcov_unsigned_t tag, const struct gcov_summary *summary)
    NULL on failure (read past EOF).  */
 
 static const gcov_unsigned_t *
-gcov_read_words (unsigned words)
+gcov_read_words (struct gcov_var *var, unsigned words)
 {
   const gcov_unsigned_t *result;
-  unsigned excess = gcov_var.length - gcov_var.offset;
+  unsigned excess = var->length - var->offset;
   
-  gcc_assert (gcov_var.mode > 0);
+  gcc_assert (var->mode > 0);
+#if GCOV_MMAP
+  if (var->map)
+    {
+      if (var->offset > var->length || excess < words)
+	{
+	  var->overread += words;
+	  var->offset = var->length;
+	  return 0;
+	}
+      result = &var->map[var->offset];
+      var->offset += words;
+      return result;
+    }
+#endif
   if (excess < words)
     {
-      gcov_var.start += gcov_var.offset;
+      var->start += var->offset;
 #if IN_LIBGCOV
       if (excess)
 	{
 	  gcc_assert (excess == 1);
-	  memcpy (gcov_var.buffer, gcov_var.buffer + gcov_var.offset, 4);
+	  memcpy (var->buffer, var->buffer + var->offset, 4);
 	}
 #else
-      memmove (gcov_var.buffer, gcov_var.buffer + gcov_var.offset, excess * 4);
+      memmove (var->buffer, var->buffer + var->offset, excess * 4);
 #endif
-      gcov_var.offset = 0;
-      gcov_var.length = excess;
+      var->offset = 0;
+      var->length = excess;
 #if IN_LIBGCOV
-      gcc_assert (!gcov_var.length || gcov_var.length == 1);
+      gcc_assert (!var->length || var->length == 1);
       excess = GCOV_BLOCK_SIZE;
 #else
-      if (gcov_var.length + words > gcov_var.alloc)
-	gcov_allocate (gcov_var.length + words);
-      excess = gcov_var.alloc - gcov_var.length;
+      if (var->length + words > var->alloc)
+	gcov_allocate (var, var->length + words);
+      excess = var->alloc - var->length;
 #endif
-      excess = fread (gcov_var.buffer + gcov_var.length,
-		      1, excess << 2, gcov_var.file) >> 2;
-      gcov_var.length += excess;
-      if (gcov_var.length < words)
+      excess = fread (var->buffer + var->length,
+		      1, excess << 2, var->file) >> 2;
+      var->length += excess;
+      if (var->length < words)
 	{
-	  gcov_var.overread += words - gcov_var.length;
-	  gcov_var.length = 0;
+	  var->overread += words - var->length;
+	  var->length = 0;
 	  return 0;
 	}
     }
-  result = &gcov_var.buffer[gcov_var.offset];
-  gcov_var.offset += words;
+  result = &var->buffer[var->offset];
+  var->offset += words;
   return result;
 }
 
@@ -422,87 +489,120 @@ gcov_read_words (unsigned words)
    error, overflow flag on overflow */
 
 GCOV_LINKAGE gcov_unsigned_t
-gcov_read_unsigned (void)
+gcov_read_unsigned_r (struct gcov_var *var)
 {
   gcov_unsigned_t value;
-  const gcov_unsigned_t *buffer = gcov_read_words (1);
+  const gcov_unsigned_t *buffer = gcov_read_words (var, 1);
 
   if (!buffer)
     return 0;
-  value = from_file (buffer[0]);
+  value = from_file (var, buffer[0]);
   return value;
 }
 
+#if IN_LIBGCOV
+GCOV_LINKAGE gcov_unsigned_t
+gcov_read_unsigned (void)
+{
+  return gcov_read_unsigned_r (&gcov_var);
+}
+#endif
+
 /* Read counter value from a coverage file. Sets error flag on file
    error, overflow flag on overflow */
 
 GCOV_LINKAGE gcov_type
-gcov_read_counter (void)
+gcov_read_counter_r (struct gcov_var *var)
 {
   gcov_type value;
-  const gcov_unsigned_t *buffer = gcov_read_words (2);
+  const gcov_unsigned_t *buffer = gcov_read_words (var, 2);
 
   if (!buffer)
     return 0;
-  value = from_file (buffer[0]);
+  value = from_file (var, buffer[0]);
   if (sizeof (value) > sizeof (gcov_unsigned_t))
-    value |= ((gcov_type) from_file (buffer[1])) << 32;
+    value |= ((gcov_type) from_file (var, buffer[1])) << 32;
   else if (buffer[1])
-    gcov_var.error = -1;
+    var->error = -1;
 
   return value;
 }
 
+#if IN_LIBGCOV
+GCOV_LINKAGE gcov_type
+gcov_read_counter (void)
+{
+  return gcov_read_counter_r (&gcov_var);
+}
+#endif
+
 /* Read string from coverage file. Returns a pointer to a static
    buffer, or NULL on empty string. You must copy the string before
-   calling another gcov function.  */
+   calling another gcov function. When the file is mapped, the string
+   is not copied and stays valid until the file is closed.  */
 
 #if !IN_LIBGCOV
 GCOV_LINKAGE const char *
-gcov_read_string (void)
+gcov_read_string_r (struct gcov_var *var)
 {
-  unsigned length = gcov_read_unsigned ();
+  unsigned length = gcov_read_unsigned_r (var);
   
   if (!length)
     return 0;
 
-  return (const char *) gcov_read_words (length);
+  return (const char *) gcov_read_words (var, length);
 }
 #endif
 
 GCOV_LINKAGE void
-gcov_read_summary (struct gcov_summary *summary)
+gcov_read_summary_r (struct gcov_var *var, struct gcov_summary *summary)
 {
   unsigned ix;
   struct gcov_ctr_summary *csum;
   
-  summary->checksum = gcov_read_unsigned ();
+  summary->checksum = gcov_read_unsigned_r (var);
   for (csum = summary->ctrs, ix = GCOV_COUNTERS_SUMMABLE; ix--; csum++)
     {
-      csum->num = gcov_read_unsigned ();
-      csum->runs = gcov_read_unsigned ();
-      csum->sum_all = gcov_read_counter ();
-      csum->run_max = gcov_read_counter ();
-      csum->sum_max = gcov_read_counter ();
+      csum->num = gcov_read_unsigned_r (var);
+      csum->runs = gcov_read_unsigned_r (var);
+      csum->sum_all = gcov_read_counter_r (var);
+      csum->run_max = gcov_read_counter_r (var);
+      csum->sum_max = gcov_read_counter_r (var);
     }
 }
 
+#if IN_LIBGCOV
+GCOV_LINKAGE void
+gcov_read_summary (struct gcov_summary *summary)
+{
+  gcov_read_summary_r (&gcov_var, summary);
+}
+#endif
+
 #if !IN_LIBGCOV
 /* Reset to a known position.  BASE should have been obtained from
    gcov_position, LENGTH should be a record length.  */
 
 GCOV_LINKAGE void
-gcov_sync (gcov_position_t base, gcov_unsigned_t length)
+gcov_sync_r (struct gcov_var *var, gcov_position_t base,
+	     gcov_unsigned_t length)
 {
-  gcc_assert (gcov_var.mode > 0);
+  gcc_assert (var->mode > 0);
   base += length;
-  if (base - gcov_var.start <= gcov_var.length)
-    gcov_var.offset = base - gcov_var.start;
+#if GCOV_MMAP
+  if (var->map)
+    {
+      var->offset = base <= var->length ? base : var->length;
+      return;
+    }
+#endif
+  if (base - var->start <= var->length)
+    var->offset = base - var->start;
   else
     {
-      gcov_var.offset = gcov_var.length = 0;
-      fseek (gcov_var.file, base << 2, SEEK_SET);
-      gcov_var.start = ftell (gcov_var.file) >> 2;
+      var->offset = var->length = 0;
+      fseek (var->file, base << 2, SEEK_SET);
+      var->start = ftell (var->file) >> 2;
     }
 }
 #endif
@@ -525,11 +625,15 @@ gcov_seek (gcov_position_t base)
 /* Return the modification time of the current gcov file.  */
 
 GCOV_LINKAGE time_t
-gcov_time (void)
+gcov_time_r (const struct gcov_var *var)
 {
   struct stat status;
   
-  if (fstat (fileno (gcov_var.file), &status))
+#if GCOV_MMAP
+  if (var->map)
+    return var->mtime;
+#endif
+  if (fstat (fileno (var->file), &status))
     return 0;
   else
     return status.st_mtime;
@@ -481,7 +481,14 @@ extern int __gcov_execve (const char *, char  *const [], char *const [])
 /* Optimum number of gcov_unsigned_t's read from or written to disk.  */
 #define GCOV_BLOCK_SIZE (1 << 10)
 
-GCOV_LINKAGE struct gcov_var
+#ifndef GCOV_MMAP
+#define GCOV_MMAP 0
+#endif
+
+/* State of a file being read or written. Outside libgcov, several
+   files can be read at once, each through its own gcov_var and the
+   _r functions; the functions without suffix use the gcov_var below.  */
+struct gcov_var
 {
   FILE *file;
   gcov_position_t start;	/* Position of first byte of block */
@@ -502,8 +509,22 @@ GCOV_LINKAGE struct gcov_var
      strings and needs to backtrack.  */
   size_t alloc;
   gcov_unsigned_t *buffer;
+#if GCOV_MMAP
+  /* The whole file when it is mapped for reading. Words and strings
+     are then read in place, and LENGTH is the size of the file.  */
+  const gcov_unsigned_t *map;
+  size_t map_size;
+  time_t mtime;
+#endif
+#endif
+};
+
+GCOV_LINKAGE struct gcov_var gcov_var ATTRIBUTE_HIDDEN;
+
+#if GCOV_MMAP
+/* Nonzero to map the files opened for reading, zero to use stdio.  */
+GCOV_LINKAGE int gcov_mmap_enabled = 1;
 #endif
-} gcov_var ATTRIBUTE_HIDDEN;
 
 /* Functions for reading and writing gcov files. In libgcov you can
    open the file for reading then writing. Elsewhere you can open the
@@ -517,18 +538,31 @@ GCOV_LINKAGE struct gcov_var
 #if IN_LIBGCOV
 GCOV_LINKAGE int gcov_open (const char * /*name*/) ATTRIBUTE_HIDDEN;
 #else
-GCOV_LINKAGE int gcov_open (const char * /*name*/, int /*direction*/);
-GCOV_LINKAGE int gcov_magic (gcov_unsigned_t, gcov_unsigned_t);
+GCOV_LINKAGE int gcov_open_r (struct gcov_var *, const char * /*name*/,
+			      int /*direction*/);
+GCOV_LINKAGE int gcov_magic_r (struct gcov_var *, gcov_unsigned_t,
+			       gcov_unsigned_t);
 #endif
+#if IN_LIBGCOV
 GCOV_LINKAGE int gcov_close (void) ATTRIBUTE_HIDDEN;
+#endif
+GCOV_LINKAGE int gcov_close_r (struct gcov_var *) ATTRIBUTE_HIDDEN;
 
 /* Available everywhere.  */
 static gcov_position_t gcov_position (void);
 static int gcov_is_error (void);
 
+#if IN_LIBGCOV
 GCOV_LINKAGE gcov_unsigned_t gcov_read_unsigned (void) ATTRIBUTE_HIDDEN;
 GCOV_LINKAGE gcov_type gcov_read_counter (void) ATTRIBUTE_HIDDEN;
 GCOV_LINKAGE void gcov_read_summary (struct gcov_summary *) ATTRIBUTE_HIDDEN;
+#endif
+GCOV_LINKAGE gcov_unsigned_t gcov_read_unsigned_r (struct gcov_var *)
+    ATTRIBUTE_HIDDEN;
+GCOV_LINKAGE gcov_type gcov_read_counter_r (struct gcov_var *)
+    ATTRIBUTE_HIDDEN;
+GCOV_LINKAGE void gcov_read_summary_r (struct gcov_var *,
+				       struct gcov_summary *) ATTRIBUTE_HIDDEN;
 
 #if IN_LIBGCOV
 /* Available only in libgcov */
@@ -542,9 +576,9 @@ static void gcov_rewrite (void);
 GCOV_LINKAGE void gcov_seek (gcov_position_t /*position*/) ATTRIBUTE_HIDDEN;
 #else
 /* Available outside libgcov */
-GCOV_LINKAGE const char *gcov_read_string (void);
-GCOV_LINKAGE void gcov_sync (gcov_position_t /*base*/,
-			     gcov_unsigned_t /*length */);
+GCOV_LINKAGE const char *gcov_read_string_r (struct gcov_var *);
+GCOV_LINKAGE void gcov_sync_r (struct gcov_var *, gcov_position_t /*base*/,
+			       gcov_unsigned_t /*length */);
 #endif
 
 #if !IN_GCOV
@@ -561,24 +595,40 @@ GCOV_LINKAGE void gcov_write_length (gcov_position_t /*position*/);
 
 #if IN_GCOV > 0
 /* Available in gcov */
-GCOV_LINKAGE time_t gcov_time (void);
+GCOV_LINKAGE time_t gcov_time_r (const struct gcov_var *);
 #endif
 
 /* Save the current position in the gcov file.  */
 
+static inline gcov_position_t
+gcov_position_r (const struct gcov_var *var)
+{
+  gcc_assert (var->mode > 0);
+  return var->start + var->offset;
+}
+
 static inline gcov_position_t
 gcov_position (void)
 {
-  gcc_assert (gcov_var.mode > 0);
-  return gcov_var.start + gcov_var.offset;
+  return gcov_position_r (&gcov_var);
 }
 
 /* Return nonzero if the error flag is set.  */
 
+static inline int
+gcov_is_error_r (const struct gcov_var *var)
+{
+#if GCOV_MMAP
+  if (var->map)
+    return var->error;
+#endif
+  return var->file ? var->error : 1;
+}
+
 static inline int
 gcov_is_error (void)
 {
-  return gcov_var.file ? gcov_var.error : 1;
+  return gcov_is_error_r (&gcov_var);
 }
 
 #if IN_LIBGCOV
@@ -18,6 +18,8 @@
 #include <getopt.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #endif
 
 
@@ -32,6 +34,11 @@
 #define xstrdup strdup
 #define _(MSG) MSG
 
+// Read the .gcno/.gcda files through a memory mapping
+#ifndef WIN32
+#define GCOV_MMAP 1
+#endif
+
 #define FATAL_EXIT_CODE 1
 #define SUCCESS_EXIT_CODE 0
 
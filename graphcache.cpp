@@ -0,0 +1,459 @@
+#include "graphcache.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Layout of an entry file: the header, the path of the graph file, then the
+// content, 8 byte aligned. In the byte order of the writer.
+const uint32_t GRAPH_ENTRY_MAGIC = 0x68707267; // "grph"
+const uint32_t GRAPH_ENTRY_VERSION = 1;
+
+struct GraphEntryHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t size;       // of the graph file
+   int64_t seconds;     // modification time of the graph file
+   int64_t nanoseconds;
+   uint32_t stamp;      // of the graph file
+   uint32_t pathSize;
+   uint64_t contentSize;
+};
+
+// Entries used within that many seconds are not touched again
+const time_t GRAPH_TOUCH_DELAY = 3600;
+
+// ---------------------------------------------------------------------------
+static
+uint64_t Align(uint64_t offset)
+{
+   return (offset + 7) & ~(uint64_t)7;
+}
+
+// ---------------------------------------------------------------------------
+static
+bool SameKey(const GraphKey& lhs, const GraphKey& rhs)
+{
+   return lhs.size == rhs.size && lhs.seconds == rhs.seconds && lhs.nanoseconds == rhs.nanoseconds && lhs.stamp == rhs.stamp;
+}
+
+// ---------------------------------------------------------------------------
+void GraphEntry::Release()
+{
+#ifndef WIN32
+   if (mapping)
+      munmap(mapping, mapped);
+#endif
+   mapping = 0;
+   mapped = 0;
+   buffer.clear();
+   shared.reset();
+   kept = false;
+   data = 0;
+   size = 0;
+}
+
+// ---------------------------------------------------------------------------
+GraphCache::GraphCache(const std::string& directory, unsigned long long maxSize, unsigned long long memory)
+   : hits(0), misses(0), stored(0), storedBytes(0), evicted(0), size(0), memoryHits(0), memoryEvicted(0), memorySize(0),
+     memoryMax(memory), directory(directory), maxSize(maxSize), temporaries(0)
+{
+   if (!this->directory.empty() && this->directory.back() != '/')
+      this->directory += '/';
+}
+
+// ---------------------------------------------------------------------------
+bool GraphCache::Open(std::string& error)
+{
+   // Each missing component of the directory is created
+   for (size_t position = 1; !directory.empty() && position <= directory.size(); ++position)
+   {
+      if (position < directory.size() && directory[position] != '/')
+         continue;
+      std::string path = directory.substr(0, position);
+#ifdef WIN32
+      if (_mkdir(path.c_str()) && errno != EEXIST)
+#else
+      if (mkdir(path.c_str(), 0777) && errno != EEXIST)
+#endif
+      {
+         error = "cannot create the graph cache " + path + ": " + strerror(errno);
+         return false;
+      }
+   }
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+// PATH, relative to the current directory unless absolute. The current
+// directory is read each time, as a server changes it from one capture to
+// the next.
+static
+std::string AbsolutePath(const std::string& path)
+{
+   if (path[0] == '/')
+      return path;
+
+   char buffer[ 4096 ];
+#ifdef WIN32
+   if (!_getcwd(buffer, sizeof(buffer)))
+#else
+   if (!getcwd(buffer, sizeof(buffer)))
+#endif
+      return path;
+   std::string absolute = buffer;
+   if (absolute.empty() || absolute.back() != '/')
+      absolute += '/';
+   return absolute + path;
+}
+
+// ---------------------------------------------------------------------------
+// Name of the entry of the graph file PATH: FNV-1a hash of the path
+std::string GraphCache::EntryName(const std::string& path) const
+{
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   for (size_t ix = 0; ix < path.size(); ++ix)
+   {
+      hash ^= (unsigned char)path[ix];
+      hash *= 0x100000001b3ULL;
+   }
+
+   char name[ 32 ];
+   snprintf(name, sizeof(name), "%016llx.graph", (unsigned long long)hash);
+   return directory + name;
+}
+
+// ---------------------------------------------------------------------------
+bool GraphCache::Find(const std::string& gcno, GraphKey& key, GraphEntry& entry)
+{
+   key = GraphKey();
+   key.path = AbsolutePath(gcno);
+
+   // Key of the graph file: its status and the stamp of its header, the
+   // third word
+   uint32_t words[3];
+#ifdef WIN32
+   struct __stat64 status;
+   FILE* file = fopen(gcno.c_str(), "rb");
+   if (!file)
+   {
+      ++misses;
+      return false;
+   }
+   key.valid = !_fstat64(_fileno(file), &status) && fread(words, sizeof(words), 1, file) == 1;
+   fclose(file);
+   key.nanoseconds = 0;
+#else
+   struct stat status;
+   int fd = open(gcno.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      ++misses;
+      return false;
+   }
+   key.valid = !fstat(fd, &status) && pread(fd, words, sizeof(words), 0) == (ssize_t)sizeof(words);
+   close(fd);
+#if defined(__APPLE__)
+   key.nanoseconds = status.st_mtimespec.tv_nsec;
+#else
+   key.nanoseconds = status.st_mtim.tv_nsec;
+#endif
+#endif
+   if (!key.valid)
+   {
+      ++misses;
+      return false;
+   }
+   key.size = status.st_size;
+   key.seconds = status.st_mtime;
+   key.stamp = words[2];
+
+   // Entry in memory, with the same key
+   if (memoryMax)
+   {
+      std::lock_guard< std::mutex > lock(memoryMutex);
+      std::unordered_map< std::string, std::list< MemoryEntry >::iterator >::iterator found = memory.find(key.path);
+      if (found != memory.end() && SameKey(found->second->key, key))
+      {
+         recent.splice(recent.begin(), recent, found->second);
+         entry.shared = found->second->content;
+         entry.data = entry.shared->data();
+         entry.size = entry.shared->size();
+         entry.kept = true;
+         return true;
+      }
+   }
+   if (directory.empty())
+   {
+      ++misses;
+      return false;
+   }
+
+   // Entry on disk, with the same key
+   const std::string name = EntryName(key.path);
+   const char* data = 0;
+   size_t dataSize = 0;
+#ifdef WIN32
+   FILE* input = fopen(name.c_str(), "rb");
+   if (input)
+   {
+      char buffer[ 64 * 1024 ];
+      size_t count;
+      while ((count = fread(buffer, 1, sizeof(buffer), input)))
+         entry.buffer.append(buffer, count);
+      fclose(input);
+      data = entry.buffer.data();
+      dataSize = entry.buffer.size();
+   }
+#else
+   int entryFd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+   if (entryFd >= 0)
+   {
+      struct stat entryStatus;
+      if (!fstat(entryFd, &entryStatus) && entryStatus.st_size >= (off_t)sizeof(GraphEntryHeader))
+      {
+         void* mapping = mmap(0, entryStatus.st_size, PROT_READ, MAP_PRIVATE, entryFd, 0);
+         if (mapping != MAP_FAILED)
+         {
+            entry.mapping = mapping;
+            entry.mapped = entryStatus.st_size;
+            data = static_cast< const char* >(mapping);
+            dataSize = entryStatus.st_size;
+         }
+
+         // Last use, for Trim
+         if (entryStatus.st_mtime + GRAPH_TOUCH_DELAY < time(0))
+            futimens(entryFd, 0);
+      }
+      close(entryFd);
+   }
+#endif
+
+   const GraphEntryHeader* header = reinterpret_cast< const GraphEntryHeader* >(data);
+   const uint64_t offset = Align(sizeof(GraphEntryHeader) + (header && dataSize >= sizeof(GraphEntryHeader) ? header->pathSize : 0));
+   if (!header || dataSize < sizeof(GraphEntryHeader)
+       || header->magic != GRAPH_ENTRY_MAGIC || header->version != GRAPH_ENTRY_VERSION
+       || header->size != key.size || header->seconds != key.seconds || header->nanoseconds != key.nanoseconds
+       || header->stamp != key.stamp || header->pathSize != key.path.size()
+       || offset > dataSize || header->contentSize > dataSize - offset
+       || memcmp(data + sizeof(GraphEntryHeader), key.path.data(), key.path.size()))
+   {
+      entry.Release();
+      ++misses;
+      return false;
+   }
+
+   entry.data = data + offset;
+   entry.size = header->contentSize;
+   if (memoryMax)
+      Remember(key, std::make_shared< const std::string >(entry.data, entry.size));
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+void GraphCache::Used(const GraphEntry& entry, bool used)
+{
+   if (!used)
+      ++misses;
+   else
+   {
+      ++hits;
+      if (entry.kept)
+         ++memoryHits;
+   }
+}
+
+// ---------------------------------------------------------------------------
+// Keep CONTENT in memory for KEY, dropping the least recently used entries
+// beyond the limit
+void GraphCache::Remember(const GraphKey& key, const std::shared_ptr< const std::string >& content)
+{
+   if (content->size() > memoryMax)
+      return;
+
+   std::lock_guard< std::mutex > lock(memoryMutex);
+   std::unordered_map< std::string, std::list< MemoryEntry >::iterator >::iterator found = memory.find(key.path);
+   if (found != memory.end())
+   {
+      memorySize -= found->second->content->size();
+      recent.erase(found->second);
+      memory.erase(found);
+   }
+
+   MemoryEntry added = { key, content };
+   recent.push_front(added);
+   memory[key.path] = recent.begin();
+   memorySize += content->size();
+
+   while (memorySize > memoryMax)
+   {
+      memorySize -= recent.back().content->size();
+      memory.erase(recent.back().key.path);
+      recent.pop_back();
+      ++memoryEvicted;
+   }
+}
+
+// ---------------------------------------------------------------------------
+void GraphCache::Store(const GraphKey& key, const std::string& content)
+{
+   if (!key.valid)
+      return;
+   if (memoryMax)
+      Remember(key, std::make_shared< const std::string >(content));
+   if (directory.empty())
+      return;
+
+   GraphEntryHeader header;
+   memset(&header, 0, sizeof(header));
+   header.magic = GRAPH_ENTRY_MAGIC;
+   header.version = GRAPH_ENTRY_VERSION;
+   header.size = key.size;
+   header.seconds = key.seconds;
+   header.nanoseconds = key.nanoseconds;
+   header.stamp = key.stamp;
+   header.pathSize = key.path.size();
+   header.contentSize = content.size();
+
+   std::string padding(Align(sizeof(header) + key.path.size()) - sizeof(header) - key.path.size(), '\0');
+
+   // Written aside, then renamed over the previous entry
+   const std::string name = EntryName(key.path);
+#ifdef WIN32
+   const std::string temporary = name + ".tmp" + std::to_string(GetCurrentProcessId()) + "." + std::to_string(temporaries++);
+#else
+   const std::string temporary = name + ".tmp" + std::to_string(getpid()) + "." + std::to_string(temporaries++);
+#endif
+   FILE* file = fopen(temporary.c_str(), "wb");
+   if (!file)
+      return;
+   bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+             && fwrite(key.path.data(), 1, key.path.size(), file) == key.path.size()
+             && fwrite(padding.data(), 1, padding.size(), file) == padding.size()
+             && fwrite(content.data(), 1, content.size(), file) == content.size();
+   if (fclose(file))
+      ok = false;
+#ifdef WIN32
+   if (!ok || !MoveFileExA(temporary.c_str(), name.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+   if (!ok || rename(temporary.c_str(), name.c_str()))
+#endif
+   {
+      remove(temporary.c_str());
+      return;
+   }
+
+   ++stored;
+   storedBytes += sizeof(header) + key.path.size() + padding.size() + content.size();
+}
+
+// ---------------------------------------------------------------------------
+void GraphCache::Trim()
+{
+   // Also when nothing was stored, for a cache beyond a new limit
+   if (directory.empty())
+      return;
+
+   // Entries, by last use
+   struct Entry
+   {
+      std::string name;
+      time_t used;
+      unsigned long long size;
+   };
+   std::vector< Entry > entries;
+   unsigned long long total = 0;
+
+   // Temporary files left by an interrupted Store are removed once old
+   auto add = [&](const char* name)
+   {
+      size_t length = strlen(name);
+      bool temporary = strstr(name, ".graph.tmp") != 0;
+      if (!temporary && (length <= 6 || strcmp(name + length - 6, ".graph")))
+         return;
+      Entry entry;
+      entry.name = directory + name;
+#ifdef WIN32
+      struct __stat64 status;
+      if (_stat64(entry.name.c_str(), &status))
+         return;
+#else
+      struct stat status;
+      if (stat(entry.name.c_str(), &status))
+         return;
+#endif
+      if (temporary)
+      {
+         if (status.st_mtime + GRAPH_TOUCH_DELAY < time(0))
+            remove(entry.name.c_str());
+         return;
+      }
+      entry.used = status.st_mtime;
+      entry.size = status.st_size;
+      total += entry.size;
+      entries.push_back(entry);
+   };
+
+#ifdef WIN32
+   WIN32_FIND_DATAA file;
+   HANDLE search = FindFirstFileA((directory + "*.graph*").c_str(), &file);
+   if (search != INVALID_HANDLE_VALUE)
+   {
+      do
+         add(file.cFileName);
+      while (FindNextFileA(search, &file));
+      FindClose(search);
+   }
+#else
+   DIR* rep = opendir(directory.c_str());
+   if (rep)
+   {
+      dirent* file;
+      while ((file = readdir(rep)))
+         add(file->d_name);
+      closedir(rep);
+   }
+#endif
+
+   if (total > maxSize)
+   {
+      std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) { return lhs.used < rhs.used; });
+      for (size_t ix = 0; ix < entries.size() && total > maxSize; ++ix)
+         if (!remove(entries[ix].name.c_str()))
+         {
+            total -= entries[ix].size;
+            ++evicted;
+         }
+   }
+   size = total;
+}
+
+// ---------------------------------------------------------------------------
+void GraphCache::ResetCounters()
+{
+   hits = 0;
+   misses = 0;
+   stored = 0;
+   storedBytes = 0;
+   evicted = 0;
+   memoryHits = 0;
+   memoryEvicted = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef __GRAPHCACHE_H_INCLUDED__
+#define __GRAPHCACHE_H_INCLUDED__
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+// ---------------------------------------------------------------------------
+// Identity of a graph file when it was looked up: an entry is only used for
+// the same path, size, modification time and stamp.
+struct GraphKey
+{
+   GraphKey() : valid(false), size(0), seconds(0), nanoseconds(0), stamp(0) {}
+
+   bool valid; // the graph file could be read
+   std::string path;
+   uint64_t size;
+   int64_t seconds;
+   int64_t nanoseconds;
+   uint32_t stamp;
+};
+
+// ---------------------------------------------------------------------------
+// Content of an entry, mapped or held in memory until released.
+class GraphEntry
+{
+public:
+   GraphEntry() : data(0), size(0), mapping(0), mapped(0), kept(false) {}
+   ~GraphEntry() { Release(); }
+
+   void Release();
+
+   const char* data; // content stored for the key
+   size_t size;
+
+private:
+   GraphEntry(const GraphEntry&);
+   GraphEntry& operator = (const GraphEntry&);
+
+   friend class GraphCache;
+   void* mapping;
+   size_t mapped;
+   std::string buffer; // when not mapped
+   std::shared_ptr< const std::string > shared; // when kept in memory
+   bool kept; // found in memory
+};
+
+// ---------------------------------------------------------------------------
+// On-disk cache of the parsed graph files, one entry file per .gcno in a
+// directory, named after a hash of its absolute path. An entry holds the
+// key of the graph file and a content given by the caller; it is replaced
+// when the graph file changes. Entries are written to a temporary file
+// then renamed, so concurrent workers and processes never see a partial
+// one. The least recently used entries are removed by Trim.
+//
+// A long running process also keeps the last entries used in memory, in
+// LRU order, the least recently used being dropped beyond a size limit.
+class GraphCache
+{
+public:
+   // Entries in DIRECTORY, none if empty, at most MAX_SIZE bytes in all
+   // after a Trim; and in memory, at most MEMORY bytes, none if 0
+   GraphCache(const std::string& directory, unsigned long long maxSize, unsigned long long memory);
+
+   // Create the directory if needed. false if it can't be, described in
+   // ERROR.
+   bool Open(std::string& error);
+
+   // Read the key of the graph file GCNO into KEY, and map its entry into
+   // ENTRY if it has the same key. false if there is no such entry, counted
+   // as a miss.
+   bool Find(const std::string& gcno, GraphKey& key, GraphEntry& entry);
+
+   // Count the ENTRY found as a hit if its content could be USED, else as
+   // a miss
+   void Used(const GraphEntry& entry, bool used);
+
+   // Replace the entry of KEY by CONTENT
+   void Store(const GraphKey& key, const std::string& content);
+
+   // Remove the least recently used entries beyond the size limit
+   void Trim();
+
+   // Set the counters to 0, e.g. between the captures of a server
+   void ResetCounters();
+
+   // Counters, for --stats
+   std::atomic< unsigned > hits;
+   std::atomic< unsigned > misses;
+   std::atomic< unsigned > stored;
+   std::atomic< unsigned long long > storedBytes;
+   std::atomic< unsigned > evicted;
+   std::atomic< unsigned long long > size; // of all the entries, after Trim
+   std::atomic< unsigned > memoryHits;
+   std::atomic< unsigned > memoryEvicted;
+   std::atomic< unsigned long long > memorySize; // of the entries in memory
+
+private:
+   GraphCache(const GraphCache&);
+   GraphCache& operator = (const GraphCache&);
+
+   std::string EntryName(const std::string& path) const;
+   void Remember(const GraphKey& key, const std::shared_ptr< const std::string >& content);
+
+   // Entries in memory, the most recently used first
+   struct MemoryEntry
+   {
+      GraphKey key;
+      std::shared_ptr< const std::string > content;
+   };
+   std::mutex memoryMutex;
+   std::list< MemoryEntry > recent;
+   std::unordered_map< std::string, std::list< MemoryEntry >::iterator > memory; // by path
+   unsigned long long memoryMax;
+
+   std::string directory; // with a trailing '/'
+   unsigned long long maxSize;
+   std::atomic< unsigned > temporaries;
+};
+
+#endif
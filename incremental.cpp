@@ -0,0 +1,334 @@
+#include "incremental.h"
+#include "binary.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Layout of a state file, in the byte order of the writer: the header and
+// the configuration, then the records of the objects, in the order of the
+// merge, and an end record, each 8 byte aligned. A record is its header,
+// the keys of the graph then data files, their paths, each NUL terminated,
+// the diagnostics of the capture, then the binary coverage file of its
+// partial infos, checked by a hash. A state without its end record was not
+// completely written.
+const uint32_t INCREMENTAL_MAGIC = 0x6e69636c; // "lcin"
+const uint32_t INCREMENTAL_VERSION = 1;
+const uint32_t INCREMENTAL_RECORD = 0x20636572; // "rec "
+const uint32_t INCREMENTAL_END = 0x20646e65; // "end "
+
+struct IncrementalHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t configurationSize;
+};
+
+struct IncrementalRecord
+{
+   uint32_t magic;
+   uint32_t files;        // graph file and data files
+   uint32_t pathsSize;
+   uint32_t noticesSize;
+   uint64_t contentSize;  // of the binary coverage file
+   uint64_t size;         // of the whole record
+   uint64_t hash;         // of the record after its header
+};
+
+// Identity of a file: an object is reused only if its files have the same
+struct FileKey
+{
+   uint64_t size;
+   int64_t seconds;
+   int64_t nanoseconds;
+};
+
+// ---------------------------------------------------------------------------
+static
+uint64_t Align(uint64_t offset)
+{
+   return (offset + 7) & ~(uint64_t)7;
+}
+
+// ---------------------------------------------------------------------------
+// FNV-1a hash of DATA
+static
+uint64_t Hash(const char* data, size_t size)
+{
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   for (size_t ix = 0; ix < size; ++ix)
+   {
+      hash ^= (unsigned char)data[ix];
+      hash *= 0x100000001b3ULL;
+   }
+   return hash;
+}
+
+// ---------------------------------------------------------------------------
+// Key of the file PATH, false if it can't be read
+static
+bool ReadKey(const std::string& path, FileKey& key)
+{
+#ifdef WIN32
+   struct __stat64 status;
+   if (_stat64(path.c_str(), &status))
+      return false;
+   key.nanoseconds = 0;
+#else
+   struct stat status;
+   if (stat(path.c_str(), &status))
+      return false;
+#if defined(__APPLE__)
+   key.nanoseconds = status.st_mtimespec.tv_nsec;
+#else
+   key.nanoseconds = status.st_mtim.tv_nsec;
+#endif
+#endif
+   key.size = status.st_size;
+   key.seconds = status.st_mtime;
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+// CONFIGURATION of the capture, completed with the current directory, to
+// which the paths of the objects and sources are relative
+static
+std::string Configuration(const std::string& configuration)
+{
+   char buffer[ 4096 ];
+#ifdef WIN32
+   if (!_getcwd(buffer, sizeof(buffer)))
+#else
+   if (!getcwd(buffer, sizeof(buffer)))
+#endif
+      buffer[0] = '\0';
+   return std::string("@") + buffer + "\n" + configuration;
+}
+
+// ---------------------------------------------------------------------------
+IncrementalState::IncrementalState()
+   : reused(0), captured(0), output(0), failed(false)
+{
+}
+
+// ---------------------------------------------------------------------------
+IncrementalState::~IncrementalState()
+{
+   // Not committed
+   if (output)
+   {
+      fclose(output);
+      remove(temporary.c_str());
+   }
+}
+
+// ---------------------------------------------------------------------------
+bool IncrementalState::Load(const std::string& filename, const std::string& configuration, std::string& reason)
+{
+   records.clear();
+   FileKey key;
+   if (!ReadKey(filename, key))
+   {
+      reason = "no previous state " + filename;
+      return false;
+   }
+   if (!previous.Open(filename))
+   {
+      reason = "cannot read " + filename;
+      return false;
+   }
+
+   const char* data = previous.Data();
+   const size_t size = previous.Size();
+   const std::string expected = Configuration(configuration);
+
+   const IncrementalHeader* header = reinterpret_cast< const IncrementalHeader* >(data);
+   if (size < sizeof(IncrementalHeader) || header->magic != INCREMENTAL_MAGIC || header->version != INCREMENTAL_VERSION)
+   {
+      reason = filename + " is not a state of this version";
+      return false;
+   }
+   if (header->configurationSize != expected.size() || size < sizeof(IncrementalHeader) + expected.size()
+       || memcmp(data + sizeof(IncrementalHeader), expected.data(), expected.size()))
+   {
+      reason = "the filter or directory changed since " + filename;
+      return false;
+   }
+
+   // Index the records, checking their layout
+   bool complete = false;
+   for (uint64_t offset = Align(sizeof(IncrementalHeader) + expected.size());
+        offset + sizeof(IncrementalRecord) <= size; )
+   {
+      const IncrementalRecord* record = reinterpret_cast< const IncrementalRecord* >(data + offset);
+      if (record->magic == INCREMENTAL_END)
+      {
+         complete = true;
+         break;
+      }
+
+      const uint64_t keys = offset + sizeof(IncrementalRecord);
+      const uint64_t paths = keys + (uint64_t)record->files * sizeof(FileKey);
+      const uint64_t content = Align(paths + record->pathsSize + record->noticesSize);
+      if (record->magic != INCREMENTAL_RECORD || !record->files || !record->pathsSize || record->files > size
+          || record->contentSize > size
+          || record->size != Align(content + record->contentSize) - offset || offset + record->size > size
+          || data[paths + record->pathsSize - 1] != '\0')
+         break;
+
+      records[ data + paths ] = offset;
+      offset += record->size;
+   }
+
+   if (!complete)
+   {
+      records.clear();
+      reason = filename + " is incomplete or corrupted";
+      return false;
+   }
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+bool IncrementalState::Reuse(const std::string& gcno, const std::vector< std::string >& gcdas, SourceInfos& infos, std::string& notices, std::string& record)
+{
+   record.clear();
+
+   // Keys and paths of the object as it is now
+   std::vector< FileKey > keys(1 + gcdas.size());
+   std::string paths(gcno.c_str(), gcno.size() + 1);
+   bool readable = ReadKey(gcno, keys[0]);
+   for (size_t ix = 0; ix < gcdas.size(); ++ix)
+   {
+      readable = readable && ReadKey(gcdas[ix], keys[1 + ix]);
+      paths.append(gcdas[ix].c_str(), gcdas[ix].size() + 1);
+   }
+   if (!readable)
+   {
+      ++captured;
+      return false;
+   }
+
+   IncrementalRecord header;
+   memset(&header, 0, sizeof(header));
+   header.magic = INCREMENTAL_RECORD;
+   header.files = keys.size();
+   header.pathsSize = paths.size();
+   record.append(reinterpret_cast< const char* >(&header), sizeof(header));
+   record.append(reinterpret_cast< const char* >(&keys[0]), keys.size() * sizeof(FileKey));
+   record += paths;
+
+   // The same in the previous state
+   std::unordered_map< std::string, size_t >::const_iterator found = records.find(gcno);
+   if (found != records.end())
+   {
+      const char* data = previous.Data() + found->second;
+      const IncrementalRecord* same = reinterpret_cast< const IncrementalRecord* >(data);
+      const uint64_t content = Align(record.size() + same->noticesSize);
+      BinaryCoverage coverage;
+      std::string error;
+      if (same->files == header.files && same->pathsSize == header.pathsSize
+          && !memcmp(data + sizeof(header), record.data() + sizeof(header), record.size() - sizeof(header))
+          && same->hash == Hash(data + sizeof(header), same->size - sizeof(header))
+          && coverage.Open(data + content, same->contentSize, error))
+      {
+         LoadBinary(coverage, infos);
+         notices.assign(data + record.size(), same->noticesSize);
+         record.assign(data, same->size);
+         ++reused;
+         return true;
+      }
+   }
+
+   ++captured;
+   return false;
+}
+
+// ---------------------------------------------------------------------------
+void IncrementalState::Record(const SourceInfos& infos, const std::string& notices, std::string& record)
+{
+   if (record.empty())
+      return;
+
+   std::string content;
+   if (!EncodeBinary(infos, content))
+   {
+      record.clear();
+      return;
+   }
+
+   IncrementalRecord* header = reinterpret_cast< IncrementalRecord* >(&record[0]);
+   header->noticesSize = notices.size();
+   header->contentSize = content.size();
+   record += notices;
+   record.resize(Align(record.size()), '\0');
+   record += content;
+   record.resize(Align(record.size()), '\0');
+   header = reinterpret_cast< IncrementalRecord* >(&record[0]);
+   header->size = record.size();
+   header->hash = Hash(record.data() + sizeof(IncrementalRecord), record.size() - sizeof(IncrementalRecord));
+}
+
+// ---------------------------------------------------------------------------
+bool IncrementalState::Begin(const std::string& filename, const std::string& configuration)
+{
+   this->filename = filename;
+#ifdef WIN32
+   temporary = filename + ".tmp" + std::to_string(GetCurrentProcessId());
+#else
+   temporary = filename + ".tmp" + std::to_string(getpid());
+#endif
+   output = fopen(temporary.c_str(), "wb");
+   if (!output)
+      return false;
+
+   const std::string text = Configuration(configuration);
+   IncrementalHeader header = { INCREMENTAL_MAGIC, INCREMENTAL_VERSION, text.size() };
+   std::string padding(Align(sizeof(header) + text.size()) - sizeof(header) - text.size(), '\0');
+   failed = fwrite(&header, sizeof(header), 1, output) != 1
+            || fwrite(text.data(), 1, text.size(), output) != text.size()
+            || fwrite(padding.data(), 1, padding.size(), output) != padding.size();
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+void IncrementalState::Add(const std::string& record)
+{
+   if (output && !failed && !record.empty())
+      failed = fwrite(record.data(), 1, record.size(), output) != record.size();
+}
+
+// ---------------------------------------------------------------------------
+bool IncrementalState::Commit()
+{
+   if (!output)
+      return false;
+
+   IncrementalRecord end;
+   memset(&end, 0, sizeof(end));
+   end.magic = INCREMENTAL_END;
+   end.size = sizeof(end);
+   bool ok = !failed && fwrite(&end, sizeof(end), 1, output) == 1;
+   if (fclose(output))
+      ok = false;
+   output = 0;
+
+#ifdef WIN32
+   if (!ok || !MoveFileExA(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+   if (!ok || rename(temporary.c_str(), filename.c_str()))
+#endif
+   {
+      remove(temporary.c_str());
+      return false;
+   }
+   return true;
+}
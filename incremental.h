@@ -0,0 +1,70 @@
+#ifndef __INCREMENTAL_H_INCLUDED__
+#define __INCREMENTAL_H_INCLUDED__
+
+#include "coverage.h"
+#include "tracefile.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// State of an incremental capture, kept in a file from one capture to the
+// next: for each object, the size and modification time of its graph and
+// data files, and its contribution to the aggregate, that is the partial
+// infos of its capture (as a binary coverage file) and its diagnostics.
+// The objects whose files did not change reuse their contribution instead
+// of being captured again. All the contributions are then merged in the
+// usual order, so the result is the one of a full capture.
+//
+// The state is used only if it was written with the same configuration
+// (the source filter) from the same directory. It is replaced by the state
+// of the new capture, written aside then renamed.
+class IncrementalState
+{
+public:
+   IncrementalState();
+   ~IncrementalState();
+
+   // Read the state FILENAME of the previous capture with CONFIGURATION.
+   // false if there is none or it can't be used, described in REASON: all
+   // the objects are then captured.
+   bool Load(const std::string& filename, const std::string& configuration, std::string& reason);
+
+   // Read the contribution of the object GCNO/GCDAS into INFOS and NOTICES,
+   // if its files did not change since the previous capture. RECORD gets
+   // the record of the object for the next state: the previous one, or if
+   // false, its keys only, to be completed by Record once captured.
+   bool Reuse(const std::string& gcno, const std::vector< std::string >& gcdas, SourceInfos& infos, std::string& notices, std::string& record);
+
+   // Complete RECORD with the contribution of the object captured, INFOS
+   // and NOTICES. An empty RECORD (unreadable files) stays empty.
+   static void Record(const SourceInfos& infos, const std::string& notices, std::string& record);
+
+   // Write the next state to FILENAME: the RECORDs added, then Commit.
+   // false if it can't be written.
+   bool Begin(const std::string& filename, const std::string& configuration);
+   void Add(const std::string& record);
+   bool Commit();
+
+   // Counters, for --stats
+   std::atomic< unsigned > reused;
+   std::atomic< unsigned > captured;
+
+private:
+   IncrementalState(const IncrementalState&);
+   IncrementalState& operator = (const IncrementalState&);
+
+   MappedFile previous;
+   std::unordered_map< std::string, size_t > records; // offset in previous, by graph file
+
+   FILE* output;
+   std::string filename;
+   std::string temporary;
+   bool failed;
+};
+
+#endif
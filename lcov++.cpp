@@ -2,19 +2,34 @@
 
 #include "lcov++.h"
 #include "demangle.h"
+#include "arena.h"
+#include "writer.h"
+#include "tracefile.h"
+#include "binary.h"
+#include "filter.h"
+#include "walker.h"
+#include "prefetch.h"
+#include "graphcache.h"
+#include "server.h"
+#include "incremental.h"
 
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <unordered_map>
+#include <deque>
+#include <set>
+#include <functional>
+#include <memory>
 
 using namespace std;
 
-// Storing infos by source
-std::map< std::string, Functions > SourceFunctions;
-std::map< std::string, Lines > SourceLines;
-std::map< std::string, Branches > SourceBranches;
-
 // --------------------------------------------------------------------------
 // This is the size of the buffer used to read in source file lines.
 #define STRING_SIZE 200
@@ -23,13 +38,17 @@ struct function_info;
 struct block_info;
 struct source_info;
 
+// No block or arc, end of an index chain
+static const unsigned NO_INDEX = ~0U;
+
 // --------------------------------------------------------------------------
-// Describes an arc between two basic blocks.
+// Describes an arc between two basic blocks. The arcs of all the functions
+// of an object are stored in one array, in graph file order.
 struct arc_info
 {
-   // source and destination blocks.
-   block_info* src;
-   block_info* dst;
+   // source and destination blocks, indices in the object's blocks.
+   unsigned src;
+   unsigned dst;
 
    // transition counts.
    gcov_type count;
@@ -54,22 +73,15 @@ struct arc_info
    unsigned int cycle : 1;
 
    // Next branch on line.
-   arc_info* line_next;
-
-   // Links to next arc on src and dst lists.
-   arc_info* succ_next;
-   arc_info* pred_next;
+   unsigned line_next;
 };
 
 // --------------------------------------------------------------------------
-// Describes a basic block. Contains lists of arcs to successor and
-// predecessor blocks.
+// Describes a basic block. The blocks of all the functions of an object are
+// stored in one array, and their arcs to successor and predecessor blocks
+// are given by the CSR index arrays of the object.
 struct block_info
 {
-   // Chain of exit and entry arcs.
-   arc_info* succ;
-   arc_info* pred;
-
    // Number of unprocessed exit and entry arcs.
    gcov_type num_succ;
    gcov_type num_pred;
@@ -92,27 +104,30 @@ struct block_info
    {
       struct
       {
-         // Array of line numbers and source files. source files are
-         // introduced by a linenumber of zero, the next 'line number' is
-         // the number of the source file.  Always starts with a source
-         // file.
-         unsigned* encoding;
+         // Range of the object's line_encodings, of line numbers and
+         // source files. source files are introduced by a linenumber of
+         // zero, the next 'line number' is the index of the source file.
+         // Always starts with a source file. FIRST is NO_INDEX until the
+         // LINES record of the block is read.
+         unsigned first;
          unsigned num;
       } line; // Valid until blocks are linked onto lines
       struct
       {
          // Single line graph cycle workspace.  Used for all-blocks mode.
-         arc_info* arc;
+         // Position in succ_arcs of the arc from the previous block of
+         // the path.
+         unsigned arc;
          unsigned ident;
       } cycle; // Used in all-blocks mode, after blocks are linked onto lines.
    } u;
 
    // Temporary chain for solving graph, and for chaining blocks on one line.
-   block_info* chain;
+   unsigned chain;
 };
 
 // --------------------------------------------------------------------------
-// Describes a single function. Contains an array of basic blocks.
+// Describes a single function. Contains a range of basic blocks and arcs.
 struct function_info
 {
    // Name of function.
@@ -120,15 +135,23 @@ struct function_info
    unsigned ident;
    unsigned checksum;
 
-   // Array of basic blocks.
-   block_info* blocks;
+   // Range of basic blocks in the object's blocks.
+   unsigned first_block;
    unsigned num_blocks;
    unsigned blocks_executed;
 
+   // Range of arcs in the object's arcs.
+   unsigned first_arc;
+   unsigned num_arcs;
+
    // Raw arc coverage counts.
    gcov_type* counts;
    unsigned num_counts;
 
+   // Some count is not zero. If not, the function takes the zero count
+   // path: its graph is not solved and its lines not searched for cycles.
+   unsigned executed : 1;
+
    // First line number.
    unsigned line;
    source_info* src;
@@ -164,26 +187,30 @@ struct line_info
    gcov_type count;           // execution count
    union
    {
-      arc_info* branches;      // branches from blocks that end on this
+      unsigned branches;      // branches from blocks that end on this
       //  line. Used for branch-counts when not
       //  all-blocks mode.
-      block_info* blocks;    // blocks which start on this line.  Used
+      unsigned blocks;        // blocks which start on this line.  Used
       // in all-blocks mode.
-   } u;
+   } u;                       // NO_INDEX if none
    unsigned exists : 1;
+   unsigned executed : 1;     // has blocks of an executed function
 };
 
 // --------------------------------------------------------------------------
 // Describes a file mentioned in the block graph.  Contains an array of line info.
 struct source_info
 {
-   source_info() : index(0), lines(0), num_lines(0), functions(0), next(0)
+   source_info() : id(0), index(0), excluded(false), lines(0), num_lines(0), functions(0), next(0)
    {}
 
-   // name of source file (include absolute path)
-   std::string name;
+   // Source file, in the SourceNames table
+   SourceId id;
    unsigned index;
 
+   // Filtered out: no lines and no infos
+   bool excluded;
+
    // Array of line information.
    line_info* lines;
    unsigned num_lines;
@@ -197,21 +224,273 @@ struct source_info
    source_info* next;
 };
 
-// Holds a list of function basic block graphs.
-static function_info* functions;
+// --------------------------------------------------------------------------
+// Describes the graph, count and source state of one object (a .gcno/.gcda
+// pair). Each capture worker owns one, reused from one object to the next.
+// The functions and counts are allocated from the arena, the blocks, arcs
+// and line encodings from vectors which keep their capacity, and all are
+// released by release_structures.
+struct object_info
+{
+   object_info() : functions(0), sources(0), program_count(0), bbg_file_time(0), gcno_stamp(0)
+   {
+      memset(&object_summary, 0, sizeof(object_summary));
+   }
+
+   // Holds a list of function basic block graphs.
+   function_info* functions;
+
+   // This points to the head of the sourcefile structure list.
+   source_info* sources;
+
+   // This holds data summary information.
+   gcov_summary object_summary;
+   unsigned program_count;
+
+   // Modification time of graph file.
+   time_t bbg_file_time;
+
+   // Stamp of the bbg file
+   unsigned gcno_stamp;
+
+   // Directory of the graph file, with its trailing '/', to which the
+   // relative source names are relative
+   std::string directory;
+
+   // Sources of this object by SourceId, NULL for the others
+   std::vector< source_info* > source_ids;
+
+   // Sources of this object by index
+   std::vector< source_info* > source_index;
+
+   // Names of the sources by index, as first given in the graph file, for
+   // the graph cache
+   std::vector< std::string > source_names;
+
+   // Blocks and arcs of all the functions
+   std::vector< block_info > blocks;
+   std::vector< arc_info > arcs;
+
+   // Successor and predecessor arcs of each block, in CSR form: the exit
+   // arcs of block B are arcs[ succ_arcs[ succ_index[B] .. succ_index[B + 1] ) ]
+   // and likewise for the entry arcs with pred_index and pred_arcs.
+   std::vector< unsigned > succ_index;
+   std::vector< unsigned > succ_arcs;
+   std::vector< unsigned > pred_index;
+   std::vector< unsigned > pred_arcs;
+
+   // Line encodings of all the blocks, the blocks of a function being
+   // contiguous.
+   std::vector< unsigned > line_encodings;
+
+   // Functions by ident, to attach the counts of the data file whatever
+   // its function order: idents are small integers, so the index is a
+   // dense vector, with a hash for the idents too large for it.
+   std::vector< function_info* > ident_index;
+   std::unordered_map< unsigned, function_info* > ident_map;
+
+   // Workspace of line_cycles_count, by block: CYCLE_ flags, and the list
+   // in cycle_pool of the blocks blocked by each block, NO_INDEX if none.
+   std::vector< unsigned char > cycle_state;
+   std::vector< unsigned > cycle_blocked_by;
+   std::vector< std::pair< unsigned, unsigned > > cycle_pool; // block, next
+   std::vector< unsigned > cycle_touched;                     // blocks to reset
+   std::vector< unsigned > cycle_unblocking;
+
+   Arena arena;
+};
+
+// Flags of cycle_state
+static const unsigned char CYCLE_BLOCKED = 1; // in the path, or leads to no loop
+static const unsigned char CYCLE_FOUND = 2;   // a loop was found since in the path
+
+// --------------------------------------------------------------------------
+// Content of a graph cache entry: the object as read_graph_file leaves it,
+// without pointers. The blocks and arcs are stored as they are in memory,
+// the functions and sources by index, and their names in a string table.
+// All the sections are 8 byte aligned:
+//
+//   graph_cache_header
+//   functions       graph_cache_function[num_functions], in graph file order
+//   sources         graph_cache_source[num_sources], by index
+//   blocks          block_info[num_blocks]
+//   arcs            arc_info[num_arcs]
+//   line_encodings  unsigned[num_encodings]
+//   succ_index      unsigned[num_blocks + 1]
+//   succ_arcs       unsigned[num_arcs]
+//   pred_index      unsigned[num_blocks + 1]
+//   pred_arcs       unsigned[num_arcs]
+//   strings         NUL terminated names
+//
+// GRAPH_CACHE_VERSION is to be changed with the layout of block_info or
+// arc_info.
+static const unsigned GRAPH_CACHE_MAGIC = 0x6f6e6367; // "gcno"
+static const unsigned GRAPH_CACHE_VERSION = 1;
+
+struct graph_cache_header
+{
+   unsigned magic;
+   unsigned version;
+   unsigned block_size; // sizeof(block_info)
+   unsigned arc_size;   // sizeof(arc_info)
+   unsigned stamp;
+   unsigned num_functions;
+   unsigned num_sources;
+   unsigned num_blocks;
+   unsigned num_arcs;
+   unsigned num_encodings;
+   unsigned strings_size;
+   unsigned reserved;
+};
+
+struct graph_cache_function
+{
+   unsigned name;   // offset in strings
+   unsigned source; // index
+   unsigned ident;
+   unsigned checksum;
+   unsigned line;
+   unsigned first_block;
+   unsigned num_blocks;
+   unsigned first_arc;
+   unsigned num_arcs;
+   unsigned num_counts;
+};
+
+struct graph_cache_source
+{
+   unsigned name; // offset in strings
+   unsigned num_lines;
+};
+
+// --------------------------------------------------------------------------
+// Files of one object: its graph file and the data files of all the data
+// directories, whose counters are summed before the graph is solved.
+struct capture_object
+{
+   std::string gcno;
+   std::vector< std::string > gcdas;
+};
+
+// --------------------------------------------------------------------------
+// Result of the capture of one object by a worker.
+struct capture_result
+{
+   capture_result() : done(false) {}
+
+   SourceInfos infos;
+
+   // Diagnostics, printed when the infos are merged.
+   std::string notices;
+
+   // Record of the object for the next incremental state, if any
+   std::string record;
+
+   bool done;
+};
+
+// --------------------------------------------------------------------------
+// Objects to capture, added by the scan while the workers may already
+// capture the first ones found. Once the scan is done, the objects are
+// merged in a fixed order, so the result does not depend on the scan order.
+struct capture_queue
+{
+   capture_queue() : scanned(false) {}
+
+   // Add OBJECT, found by the scan
+   void Add(capture_object&& object)
+   {
+      std::lock_guard< std::mutex > lock(mutex);
+      objects.push_back(std::move(object));
+      changed.notify_all();
+   }
+
+   // The scan is done: the objects are merged sorted by their first .gcda
+   // file if SORT, else in the order they were added.
+   void Done(bool sort)
+   {
+      std::lock_guard< std::mutex > lock(mutex);
+      order.resize(objects.size());
+      for (size_t ix = 0; ix < order.size(); ++ix)
+         order[ix] = ix;
+      if (sort)
+         std::sort(order.begin(), order.end(), [this](size_t left, size_t right) { return objects[left].gcdas[0] < objects[right].gcdas[0]; });
+      scanned = true;
+      changed.notify_all();
+   }
+
+   std::mutex mutex;
+   std::condition_variable changed;      // an object is added, the scan is done, or a result is done or merged
+   std::deque< capture_object > objects; // in the order found
+   std::vector< size_t > order;          // indices in objects, in merge order, once scanned
+   bool scanned;
+};
+
+// Diagnostics of the object processed by this thread, if they are delayed.
+static thread_local std::string* notices;
+
+// Progress messages, on stderr when the tracefile is written to stdout.
+static std::ostream* progress = &cout;
 
-// This points to the head of the sourcefile structure list.
-static source_info* sources;
+// --------------------------------------------------------------------------
+// Counters printed by --stats. Times are summed over all the workers.
+struct capture_stats
+{
+   capture_stats() : read_time(0), solve_time(0), files_read(0), functions(0), zero_functions(0), cycle_iterations(0), cycle_max(0), cycle_checks(0), cycle_mismatches(0), allocations(0), allocated_bytes(0), chunks(0), resets(0) {}
+
+   std::atomic< double > read_time;  // reading the graph and count files, waiting for them
+   std::atomic< double > solve_time; // solving the graphs and aggregating their counts
+   std::atomic< unsigned > files_read;
+   std::atomic< unsigned > functions;      // solved
+   std::atomic< unsigned > zero_functions; // solved by the zero count path
+
+   // Cycle search of the lines
+   std::atomic< unsigned long long > cycle_iterations;
+   std::atomic< unsigned long long > cycle_max;        // on one line
+   std::atomic< unsigned > cycle_checks;               // lines checked by --check-cycles
+   std::atomic< unsigned > cycle_mismatches;
+
+   // Arenas of the objects
+   std::atomic< unsigned long long > allocations;
+   std::atomic< unsigned long long > allocated_bytes;
+   std::atomic< unsigned long long > chunks;
+   std::atomic< unsigned long long > resets;
+
+   void add_cycle_iterations(unsigned long long iterations)
+   {
+      cycle_iterations += iterations;
+      unsigned long long current = cycle_max.load();
+      while (current < iterations && !cycle_max.compare_exchange_weak(current, iterations))
+         ;
+   }
 
-// This holds data summary information.
-static struct gcov_summary object_summary;
-static unsigned program_count;
+   void reset()
+   {
+      read_time = 0;
+      solve_time = 0;
+      files_read = 0;
+      functions = 0;
+      zero_functions = 0;
+      cycle_iterations = 0;
+      cycle_max = 0;
+      cycle_checks = 0;
+      cycle_mismatches = 0;
+      allocations = 0;
+      allocated_bytes = 0;
+      chunks = 0;
+      resets = 0;
+   }
 
-// Modification time of graph file.
-static time_t bbg_file_time;
+   void add(const Arena& arena)
+   {
+      allocations += arena.allocations;
+      allocated_bytes += arena.bytes;
+      chunks += arena.chunks;
+      resets += arena.resets;
+   }
+};
 
-// Stamp of the bbg file
-static unsigned gcno_stamp;
+static capture_stats stats;
 
 // Output branch probabilities.
 static int flag_branches = 1; //0;
@@ -223,197 +502,1044 @@ static int flag_unconditional = 0;
 // that contain line number information.
 static int flag_all_blocks = 1; //0;
 
+// Functions whose counts are all zero skip the cycle search, their counts
+// being all zero anyway. Their graphs are still solved, to report the
+// unsolvable ones as gcov does.
+static int flag_zero_path = 1;
+
+// Check the cycle search of each line against the one of gcov.
+static int flag_check_cycles = 0;
+
+// Report the lines whose cycle search takes at least that many iterations,
+// 0 for none.
+static unsigned long long flag_log_cycles = 0;
+
 // Output the number of times a branch was taken as opposed to the percentage
 // of times it was taken.
 static int flag_counts = 1; //0;
 
+// Cache of the parsed graph files, if any.
+static GraphCache* graph_cache = 0;
+
+// Cache kept by a server for all its runs, if serving.
+static GraphCache* server_graph_cache = 0;
+
+// State of the incremental capture, if any.
+static IncrementalState* incremental_state = 0;
+
 // Forward declarations.
 static void fnotice(FILE*, const char*, ...);
-static void process_file(const std::string&);
+static void process_file(object_info*, const capture_object&, SourceInfos&);
 static std::string createGCNOfilename(const std::string&);
-static source_info* find_source(const char*, const std::string& gcnoFilename);
-static int read_graph_file(const std::string& gcnoFilename);
-static int read_count_file(const std::string& gcdaFilename);
-static void solve_flow_graph(function_info*, const std::string& gcnoFilename);
-static void add_branch_counts(coverage_info*, const arc_info*);
-static void add_line_counts(function_info*, const std::string& gcnoFilename);
+static source_info* find_source(object_info*, const char*);
+static void set_graph_directory(object_info*, const std::string& gcnoFilename);
+static void insert_function(source_info*, function_info*);
+static int read_graph(object_info*, struct gcov_var* reader, const std::string& gcnoFilename);
+static int read_graph_file(object_info*, struct gcov_var* reader, const std::string& gcnoFilename);
+static int read_graph_cache(object_info*, const char* data, size_t size, const GraphKey& key, const std::string& gcnoFilename);
+static void write_graph_cache(const object_info*, std::string& data);
+static int read_count_file(object_info*, struct gcov_var* reader, const std::string& gcdaFilename);
+static bool any_count(const gcov_type*, unsigned);
+static void build_arc_index(object_info*);
+static void build_ident_index(object_info*);
+static function_info* find_function(const object_info*, unsigned ident);
+static void solve_flow_graph(object_info*, function_info*, const std::string& gcnoFilename);
+static void add_branch_counts(const object_info*, coverage_info*, const arc_info*);
+static void add_line_counts(object_info*, function_info*, const std::string& gcnoFilename);
 static void function_summary(const coverage_info*, const char*);
 static const char* format_gcov(gcov_type, gcov_type, int);
-static void accumulate_line_counts(source_info*);
-static int output_branch_count(int, const arc_info*, int& branch, gcov_type& taken);
+static void accumulate_line_counts(object_info*, source_info*);
+static int output_branch_count(const object_info*, int, const arc_info*, int& branch, gcov_type& taken);
 static void output_lines(FILE*, const source_info*, const std::string& gcdaFilename, const std::string& gcnoFilename);
-static void aggregate_info(const source_info*);
+static void aggregate_info(const object_info*, const source_info*, SourceInfos&);
 static std::string make_gcov_file_name(const std::string&);
-static void release_structures(void);
+static void release_structures(object_info*);
+
+// ---------------------------------------------------------------------------
+// Command line options
+struct Options
+{
+   Options() : directory("."), follow(false), maxDepth(-1), prefetch(0), zeroPath(true), checkCycles(false), logCycles(0), graphCacheSize(256), cacheMemory(512), noExternal(false), output("app.info"), jobs(1), stats(false), mmap(GCOV_MMAP), compress(false), binary(false), outputSet(false) {}
+
+   std::string directory;
+   std::vector< std::string > inputs; // all the non option arguments
+   std::string buildDirectory;        // of the .gcno files, if not with the .gcda files
+   std::vector< std::string > lists;  // of .gcda files, - for stdin
+   bool follow;                       // follow the links to directories in the scan
+   int maxDepth;                      // of the directories scanned, -1 for no limit
+   unsigned prefetch;                 // # of objects read ahead of the capture, 0 for none
+   bool zeroPath;                     // fast path for the functions with zero counts
+   bool checkCycles;                  // check the cycle search of the lines against the one of gcov
+   unsigned long long logCycles;      // report the lines whose cycle search takes this many iterations
+   std::string graphCache;            // directory of the cache of the parsed graph files, if any
+   unsigned long long graphCacheSize; // in MB
+   std::string serve;                 // socket of the server to run, if any
+   std::string connect;               // socket of the server to send the request to, if any
+   unsigned long long cacheMemory;    // in MB, of the graphs kept in memory by the server
+   std::string incremental;           // state of the incremental capture, if any
+   std::vector< std::string > tracefiles; // to merge instead of capturing
+   SourceFilter filter;                   // sources kept
+   bool noExternal;                       // keep only the sources under the directory or base directory
+   std::string baseDirectory;
+   std::string output; // tracefile, - for stdout
+   unsigned jobs;  // # of capture workers, 1 for a serial capture
+   bool stats;     // print the timings of each phase on stderr
+   bool mmap;      // map the .gcno/.gcda files instead of reading them with stdio
+   bool compress;  // gzip the tracefile
+   bool binary;    // write a binary coverage file instead of a tracefile
+   bool outputSet; // output given by the user
+};
+
+// ---------------------------------------------------------------------------
+static
+void Usage(const char* program)
+{
+   cerr << "Usage: " << program << " [options] [directory... | file.gcda... | @list...]" << endl
+        << "       " << program << " --serve S [--cache-memory M] [--graph-cache D]   (capture server on the socket S)" << endl
+        << "       " << program << " --connect S [options] [directory...]   (run by the server on the socket S)" << endl
+        << "       " << program << " convert [options] file    (tracefile <-> binary coverage file)" << endl
+        << "       " << program << " merge [options] file...   (same as -a file...)" << endl
+        << "  -o, --output-file F  write the tracefile to F (default app.info, - for stdout)" << endl
+        << "      --files-from L   capture the .gcda files listed in L, one per line (- for stdin)" << endl
+        << "  -f, --follow         follow the links to directories when scanning" << endl
+        << "      --max-depth N    scan at most N levels of directories below each directory" << endl
+        << "      --build-directory B  read the .gcno files from B instead of the data directories" << endl
+        << "  -a, --add-tracefile F  merge the tracefile or binary coverage file F, no capture" << endl
+        << "  -j, --jobs N         capture with N threads (0 for one per core, default 1)" << endl
+        << "  -z, --compress       gzip the tracefile (default for a .gz output file)" << endl
+        << "  -b, --binary         write a binary coverage file (default for a .covb output file)" << endl
+        << "      --include P      keep only the sources matching the glob P (may be repeated)" << endl
+        << "      --exclude P      drop the sources matching the glob P (may be repeated)" << endl
+        << "      --no-external    drop the sources outside the directory and base directory" << endl
+        << "      --base-directory D  directory of the sources for --no-external" << endl
+        << "      --prefetch K     read the files of the next K objects ahead of the capture" << endl
+        << "      --graph-cache D  keep the parsed .gcno files in the directory D for the next captures" << endl
+        << "      --graph-cache-size M  limit the graph cache to M MB (default 256)" << endl
+        << "      --cache-memory M  keep at most M MB of graphs in memory with --serve (default 512)" << endl
+        << "      --incremental F  reuse the capture of the objects unchanged since the capture which wrote F" << endl
+        << "      --no-fast-path   search the line cycles of the functions with zero counts too (to compare)" << endl
+        << "      --check-cycles   check the line counts against the cycle search of gcov" << endl
+        << "      --log-cycles N   report the lines whose cycle search takes N iterations or more" << endl
+        << "      --stats          print the timings of each phase on stderr" << endl
+        << "      --no-mmap        read the .gcno/.gcda files with stdio instead of mapping them" << endl;
+}
+
+// ---------------------------------------------------------------------------
+// Value of option NAME, either glued ("-j4", "--jobs=4") or in the next
+// argument. Returns 0 if ARG is not this option or if the value is missing.
+static
+const char* OptionValue(int argc, char* argv[], int& ix, const char* shortName, const char* longName)
+{
+   const char* arg = argv[ix];
+   size_t length = strlen(longName);
+
+   if (shortName && !strncmp(arg, shortName, 2))
+      arg += 2;
+   else if (!strncmp(arg, longName, length) && (!arg[length] || arg[length] == '='))
+      arg += length + (arg[length] == '=');
+   else
+      return 0;
+
+   if (*arg)
+      return arg;
+   if (ix + 1 < argc)
+      return argv[++ix];
+   return 0;
+}
+
+// ---------------------------------------------------------------------------
+static
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+   for (int ix = 1; ix < argc; ++ix)
+   {
+      const char* arg = argv[ix];
+      const char* value;
+
+      if (!strcmp(arg, "--stats"))
+         options.stats = true;
+      else if (!strcmp(arg, "--no-mmap"))
+         options.mmap = false;
+      else if (!strcmp(arg, "-z") || !strcmp(arg, "--compress"))
+         options.compress = true;
+      else if (!strcmp(arg, "-b") || !strcmp(arg, "--binary"))
+         options.binary = true;
+      else if (!strcmp(arg, "-f") || !strcmp(arg, "--follow"))
+         options.follow = true;
+      else if ((value = OptionValue(argc, argv, ix, 0, "--files-from")))
+         options.lists.push_back(value);
+      else if ((value = OptionValue(argc, argv, ix, 0, "--prefetch")))
+         options.prefetch = atoi(value);
+      else if ((value = OptionValue(argc, argv, ix, 0, "--max-depth")))
+         options.maxDepth = atoi(value);
+      else if ((value = OptionValue(argc, argv, ix, 0, "--graph-cache-size")))
+         options.graphCacheSize = strtoull(value, 0, 10);
+      else if ((value = OptionValue(argc, argv, ix, 0, "--graph-cache")))
+         options.graphCache = value;
+      else if ((value = OptionValue(argc, argv, ix, 0, "--cache-memory")))
+         options.cacheMemory = strtoull(value, 0, 10);
+      else if ((value = OptionValue(argc, argv, ix, 0, "--incremental")))
+         options.incremental = value;
+      else if ((value = OptionValue(argc, argv, ix, 0, "--serve")))
+         options.serve = value;
+      else if ((value = OptionValue(argc, argv, ix, 0, "--connect")))
+         options.connect = value;
+      else if (!strcmp(arg, "--no-fast-path"))
+         options.zeroPath = false;
+      else if (!strcmp(arg, "--check-cycles"))
+         options.checkCycles = true;
+      else if ((value = OptionValue(argc, argv, ix, 0, "--log-cycles")))
+         options.logCycles = strtoull(value, 0, 10);
+      else if (!strcmp(arg, "--no-external"))
+         options.noExternal = true;
+      else if ((value = OptionValue(argc, argv, ix, 0, "--include")))
+         options.filter.Include(value);
+      else if ((value = OptionValue(argc, argv, ix, 0, "--exclude")))
+         options.filter.Exclude(value);
+      else if ((value = OptionValue(argc, argv, ix, 0, "--base-directory")))
+         options.baseDirectory = value;
+      else if ((value = OptionValue(argc, argv, ix, 0, "--build-directory")))
+         options.buildDirectory = value;
+      else if ((value = OptionValue(argc, argv, ix, "-a", "--add-tracefile")))
+         options.tracefiles.push_back(value);
+      else if ((value = OptionValue(argc, argv, ix, "-o", "--output-file")))
+      {
+         options.output = value;
+         options.outputSet = true;
+      }
+      else if ((value = OptionValue(argc, argv, ix, "-j", "--jobs")))
+      {
+         options.jobs = atoi(value);
+         if (!options.jobs)
+            options.jobs = std::max(1u, std::thread::hardware_concurrency());
+      }
+      else if (arg[0] == '-' && arg[1])
+      {
+         cerr << "Unknown or incomplete option " << arg << endl;
+         return false;
+      }
+      else
+      {
+         options.directory = arg;
+         options.inputs.push_back(arg);
+      }
+   }
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+// Seconds elapsed since START
+static
+double Elapsed(const std::chrono::steady_clock::time_point& start)
+{
+   return std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+}
+
+// ---------------------------------------------------------------------------
+// Add the seconds elapsed since START to TOTAL
+static
+void AddElapsed(std::atomic< double >& total, const std::chrono::steady_clock::time_point& start)
+{
+   double seconds = Elapsed(start);
+   double current = total.load();
+   while (!total.compare_exchange_weak(current, current + seconds))
+      ;
+}
+
+// ---------------------------------------------------------------------------
+// Read ahead the files of OBJECT
+static
+void Prefetch(Prefetcher& prefetcher, const capture_object& object)
+{
+   prefetcher.Add(object.gcno);
+   for (size_t ix = 0; ix < object.gcdas.size(); ++ix)
+      prefetcher.Add(object.gcdas[ix]);
+}
+
+// ---------------------------------------------------------------------------
+// Capture OBJECT into RESULT, using OBJ, or reuse its contribution to the
+// previous incremental capture if its files did not change.
+static
+void CaptureObject(object_info* obj, const capture_object& object, capture_result& result)
+{
+   if (incremental_state && incremental_state->Reuse(object.gcno, object.gcdas, result.infos, result.notices, result.record))
+      return;
+
+   notices = &result.notices;
+   release_structures(obj);
+   process_file(obj, object, result.infos);
+   notices = 0;
+   if (incremental_state)
+      IncrementalState::Record(result.infos, result.notices, result.record);
+}
 
 // ---------------------------------------------------------------------------
-bool IsGCDA(const char* filename)
-{
-   size_t size = strlen(filename);
-   return (size > 5
-           && filename[ size - 5 ] == '.'
-           && filename[ size - 4 ] == 'g'
-           && filename[ size - 3 ] == 'c'
-           && filename[ size - 2 ] == 'd'
-           && filename[ size - 1 ] == 'a');
+// Merge RESULT, once its progress is printed
+static
+void MergeResult(capture_result& result)
+{
+   fputs(result.notices.c_str(), stderr);
+   MergeInfos(result.infos);
+   if (incremental_state)
+      incremental_state->Add(result.record);
+   result = capture_result();
 }
 
 // ---------------------------------------------------------------------------
-std::vector< std::string > ReadDir(const std::string& fullName, const char* shortName = 0, int currentLevel = 0)
+// Process the files one after the other, in the current thread. The files
+// of the next AHEAD objects are read ahead by PREFETCHER, if any.
+static
+void CaptureSerial(const capture_queue& queue, Prefetcher* prefetcher, unsigned ahead)
 {
-   std::vector< std::string > filenames;
+   object_info object;
+   size_t prefetched = 1; // next object to read ahead
 
-#ifdef WIN32
-   WIN32_FIND_DATAA file;
-   std::string filter = fullName + "/*";
-   HANDLE hSearch = FindFirstFileA(filter.c_str(), &file);
-   if (hSearch != INVALID_HANDLE_VALUE)
+   for (size_t ix = 0; ix < queue.order.size(); ++ix)
    {
-      do
+      for (; prefetcher && prefetched < std::min(ix + 1 + ahead, queue.order.size()); ++prefetched)
+         Prefetch(*prefetcher, queue.objects[ queue.order[prefetched] ]);
+
+      const capture_object& current = queue.objects[ queue.order[ix] ];
+      for (size_t jx = 0; jx < current.gcdas.size(); ++jx)
+         *progress << "Processing " << current.gcdas[jx] << endl;
+
+      capture_result result;
+      CaptureObject(&object, current, result);
+      MergeResult(result);
+   }
+   release_structures(&object);
+   stats.add(object.arena);
+}
+
+// ---------------------------------------------------------------------------
+// Process the objects of QUEUE with JOBS workers. Each worker builds the
+// partial infos of one object at a time, and the partials are merged in the
+// order of the queue, so the result is the same as with CaptureSerial. While
+// the scan runs, the workers capture the objects in the order found; then in
+// the merge order. Workers stay at most a few objects ahead of the merge to
+// bound the memory held. The files of the next AHEAD objects to capture are
+// read ahead by PREFETCHER, if any.
+static
+void CaptureParallel(capture_queue& queue, unsigned jobs, Prefetcher* prefetcher, unsigned ahead)
+{
+   const size_t window = 4 * jobs;
+
+   // By index in queue.objects. Grown under the queue mutex, whose elements
+   // stay in place.
+   std::deque< capture_result > results;
+   std::deque< char > claimed;
+   std::deque< char > prefetched;
+   size_t found = 0;   // next object found to capture during the scan
+   size_t early = 0;   // # of objects captured during the scan
+   size_t next = 0;    // next object of the merge order to capture
+   size_t merging = 0; // next object of the merge order to merge
+
+   std::vector< std::thread > workers;
+   for (unsigned job = 0; job < jobs; ++job)
+      workers.push_back(std::thread([&]()
       {
-         if (file.dwFileAttributes == FILE_ATTRIBUTE_DIRECTORY)
+         object_info object;
+         for (;;)
          {
-            if (file.cFileName[0] == '.')
-               continue;
+            const capture_object* current;
+            capture_result* result;
+            {
+               std::unique_lock< std::mutex > lock(queue.mutex);
+               queue.changed.wait(lock, [&]()
+               {
+                  if (!queue.scanned)
+                     return found < queue.objects.size() && early < window;
+                  // The merge may not have grown claimed to all the objects yet
+                  while (next < queue.order.size() && queue.order[next] < claimed.size() && claimed[ queue.order[next] ])
+                     ++next;
+                  return next >= queue.order.size() || next < merging + window;
+               });
+
+               size_t ix;
+               if (!queue.scanned)
+               {
+                  ix = found++;
+                  ++early;
+               }
+               else if (next >= queue.order.size())
+                  break;
+               else
+                  ix = queue.order[next++];
+
+               while (results.size() <= ix)
+               {
+                  results.emplace_back();
+                  claimed.push_back(0);
+                  prefetched.push_back(0);
+               }
+               claimed[ix] = 1;
+               current = &queue.objects[ix];
+               result = &results[ix];
+
+               // Read ahead the objects to be claimed next
+               const size_t first = queue.scanned ? next : found;
+               const size_t last = std::min(queue.scanned ? queue.order.size() : queue.objects.size(), first + ahead);
+               for (size_t position = first; prefetcher && position < last; ++position)
+               {
+                  size_t jx = queue.scanned ? queue.order[position] : position;
+                  while (prefetched.size() <= jx)
+                  {
+                     results.emplace_back();
+                     claimed.push_back(0);
+                     prefetched.push_back(0);
+                  }
+                  if (!claimed[jx] && !prefetched[jx])
+                  {
+                     prefetched[jx] = 1;
+                     Prefetch(*prefetcher, queue.objects[jx]);
+                  }
+               }
+            }
+
+            CaptureObject(&object, *current, *result);
 
-            std::vector< std::string > tmp = ReadDir(fullName + "/" + file.cFileName, file.cFileName, currentLevel + 3);
-            filenames.insert(filenames.end(), tmp.begin(), tmp.end());
+            std::lock_guard< std::mutex > lock(queue.mutex);
+            result->done = true;
+            queue.changed.notify_all();
          }
+         release_structures(&object);
+         stats.add(object.arena);
+      }));
+
+   // No object is added once scanned
+   {
+      std::unique_lock< std::mutex > lock(queue.mutex);
+      queue.changed.wait(lock, [&]() { return queue.scanned; });
+      while (results.size() < queue.objects.size())
+      {
+         results.emplace_back();
+         claimed.push_back(0);
+         prefetched.push_back(0);
+      }
+   }
 
-         if (IsGCDA(file.cFileName))
-            filenames.push_back(fullName + "/" + file.cFileName);
+   const size_t count = queue.order.size();
+   while (merging < count)
+   {
+      const size_t ix = queue.order[merging];
+      capture_result& result = results[ix];
+      {
+         std::unique_lock< std::mutex > lock(queue.mutex);
+         queue.changed.wait(lock, [&]() { return result.done; });
       }
-      while (FindNextFileA(hSearch, &file));
 
-      FindClose(hSearch);
+      const std::vector< std::string >& gcdas = queue.objects[ix].gcdas;
+      for (size_t jx = 0; jx < gcdas.size(); ++jx)
+         *progress << "Processing " << gcdas[jx] << endl;
+      MergeResult(result);
+
+      std::lock_guard< std::mutex > lock(queue.mutex);
+      ++merging;
+      queue.changed.notify_all();
    }
-#else
 
-   DIR* rep = opendir(fullName.c_str());
-   if (!rep)
+   for (size_t ix = 0; ix < workers.size(); ++ix)
+      workers[ix].join();
+}
+
+// ---------------------------------------------------------------------------
+// Call ADD for each .gcda file of the list FILENAME, one per line, - for
+// stdin. Returns false if the list can't be read.
+static
+bool ReadList(const std::string& filename, const std::function< void(const std::string&) >& add)
+{
+   std::ifstream file;
+   if (filename != "-")
    {
-      cerr << "opendir error [" << errno << "] on [" << fullName << "]"<< endl;
-      return filenames;
+      file.open(filename.c_str());
+      if (!file)
+         return false;
    }
+   std::istream& in = filename == "-" ? cin : file;
 
-   dirent* entry;
-   while ((entry = readdir(rep)))
+   std::string line;
+   while (std::getline(in, line))
    {
-      if (entry->d_type == DT_DIR)
-      {
-         if (entry->d_name[0] == '.')
-            continue;
+      size_t end = line.find_last_not_of(" \t\r");
+      if (end == std::string::npos)
+         continue;
+      line.resize(end + 1);
+      add(line);
+   }
+   return !in.bad();
+}
 
-         std::vector< std::string > tmp = ReadDir(fullName + "/" + entry->d_name, entry->d_name, currentLevel + 3);
-         filenames.insert(filenames.end(), tmp.begin(), tmp.end());
-      }
+// ---------------------------------------------------------------------------
+// Add to QUEUE the objects of the .gcda files found in DIRECTORIES, of the
+// FILES and of the files listed in LISTS (see ReadList). The listed files
+// are taken once each. The .gcda files of an object in several directories,
+// e.g. one per test shard run with GCOV_PREFIX, are grouped by .gcno file:
+// the one beside each .gcda file, or at the same relative path under
+// BUILD_DIRECTORY if not empty (the path of a listed file being relative to
+// BUILD_DIRECTORY). With one directory, or only listed files, each object is
+// added as soon as found; else once all are found, in the order of their
+// first .gcda file, the directories first. DATA_FILES is the # of .gcda
+// files.
+static
+void ScanInputs(const std::vector< std::string >& directories, const std::vector< std::string >& files, const std::vector< std::string >& lists,
+                const std::string& buildDirectory, DirectoryWalker& walker, capture_queue& queue, size_t& dataFiles)
+{
+   const bool listed = !files.empty() || !lists.empty();
+   const bool stream = directories.size() + listed == 1;
+   std::vector< capture_object > objects;
+   std::unordered_map< std::string, size_t > index; // .gcno file -> objects index
+   dataFiles = 0;
+
+   // Object of GCDA, relative to the data directory at PREFIX in GCDA
+   auto object = [&](const std::string& gcda, size_t prefix)
+   {
+      capture_object object;
+      object.gcno = createGCNOfilename(buildDirectory.empty() ? gcda : buildDirectory + (prefix ? "" : "/") + gcda.substr(prefix));
+      object.gcdas.push_back(gcda);
+      return object;
+   };
+   // Group GCDA with the other files of its object
+   auto group = [&](const std::string& gcda, size_t prefix)
+   {
+      capture_object current = object(gcda, prefix);
+      std::pair< std::unordered_map< std::string, size_t >::iterator, bool > inserted = index.insert(std::make_pair(current.gcno, objects.size()));
+      if (inserted.second)
+         objects.push_back(std::move(current));
       else
       {
-         // We have a file but is this a gcda file (.gcda)
-         if (IsGCDA(entry->d_name))
-            filenames.push_back(fullName + "/" + entry->d_name);
+         std::vector< std::string >& gcdas = objects[ inserted.first->second ].gcdas;
+         if (std::find(gcdas.begin(), gcdas.end(), gcda) == gcdas.end())
+            gcdas.push_back(gcda);
       }
+   };
+
+   for (size_t ix = 0; ix < directories.size(); ++ix)
+   {
+      const std::string& directory = directories[ix];
+      if (stream)
+         walker.found = [&](const std::string& gcda) { queue.Add(object(gcda, directory.size())); };
+
+      *progress << "Scanning " << directory << " for .gcda files ..." << endl;
+      std::vector< std::string > GCDAFilenames = walker.Walk(directory);
+      *progress << "Found " << GCDAFilenames.size() << " data files in " << directory << endl;
+      dataFiles += GCDAFilenames.size();
+      if (stream)
+         break;
+
+      std::sort(GCDAFilenames.begin(), GCDAFilenames.end());
+      for (size_t jx = 0; jx < GCDAFilenames.size(); ++jx)
+         group(GCDAFilenames[jx], directory.size());
    }
-   closedir(rep);
-#endif
 
-   return filenames;
+   // The listed files, in a set for the order and the duplicates
+   std::set< std::string > names;
+   auto add = [&](const std::string& gcda)
+   {
+      if (names.insert(gcda).second && stream)
+         queue.Add(object(gcda, 0));
+   };
+   for (size_t ix = 0; ix < files.size(); ++ix)
+      add(files[ix]);
+   for (size_t ix = 0; ix < lists.size(); ++ix)
+   {
+      *progress << "Reading the data files listed in " << lists[ix] << endl;
+      if (!ReadList(lists[ix], add))
+         fnotice(stderr, "%s:cannot read the list of data files\n", lists[ix].c_str());
+   }
+   if (listed)
+      *progress << "Found " << names.size() << " listed data files" << endl;
+   dataFiles += names.size();
+   if (!stream)
+      for (std::set< std::string >::const_iterator it = names.begin(); it != names.end(); ++it)
+         group(*it, 0);
+
+   for (size_t ix = 0; ix < objects.size(); ++ix)
+      queue.Add(std::move(objects[ix]));
+   queue.Done(stream);
 }
 
-// --------------------------------------------------------------------------
-int main(int argc, char* argv[])
+// ---------------------------------------------------------------------------
+bool EndsWith(const std::string& text, const char* suffix)
 {
-   std::string directory = (argc > 1 ? argv[1] : ".");
+   size_t length = strlen(suffix);
+   return text.size() > length && !text.compare(text.size() - length, length, suffix);
+}
+
+// ---------------------------------------------------------------------------
+// Read the tracefile or binary coverage file FILENAME into INFOS. BINARY
+// is set to the format of the file.
+bool ReadCoverage(const std::string& filename, SourceInfos& infos, bool& binary)
+{
+   MappedFile file;
+   if (!file.Open(filename))
+   {
+      fnotice(stderr, "%s:cannot open coverage file\n", filename.c_str());
+      return false;
+   }
 
-   cout << "Capturing coverage data from " << directory << endl;
+   std::string error;
+   binary = IsBinaryCoverage(file.Data(), file.Size());
+   if (binary)
+   {
+      BinaryCoverage coverage;
+      if (coverage.Open(file.Data(), file.Size(), error))
+      {
+         LoadBinary(coverage, infos);
+         return true;
+      }
+   }
+   else if (ParseTracefile(file.Data(), file.Size(), infos, error))
+      return true;
 
-   // All filenames for the arc count data.
-   cout << "Scanning " << directory << " for .gcda files ..." << endl;
-   std::vector< std::string > GCDAFilenames = ReadDir(directory);
-   std::sort(GCDAFilenames.begin(), GCDAFilenames.end());
-   cout << "Found " << GCDAFilenames.size() << " data files in " << directory << endl;
+   fnotice(stderr, "%s:%s\n", filename.c_str(), error.c_str());
+   return false;
+}
+
+// ---------------------------------------------------------------------------
+// Write the Coverage aggregate to the output of OPTIONS, as a binary
+// coverage file if BINARY, else as a tracefile. COMPRESS is set if the
+// tracefile is gzipped.
+bool WriteCoverage(const Options& options, bool binary, bool& compress, unsigned& sources)
+{
+   const std::string& output = options.output;
+   compress = !binary && (options.compress || EndsWith(output, ".gz"));
+   bool ok = binary ? WriteBinary(output, sources) : WriteTracefile(output, options.jobs, compress, sources);
+   if (!ok)
+      fnotice(stderr, "%s:cannot write %s\n", output.c_str(), binary ? "coverage file" : "tracefile");
+   return ok;
+}
 
-   // Process all found files
-   for (std::vector< std::string >::const_iterator it = GCDAFilenames.begin(); it != GCDAFilenames.end(); ++it)
+// ---------------------------------------------------------------------------
+// Filter the sources as OPTIONS, DIRECTORIES and the base directory being
+// internal for --no-external. Before any source is interned.
+void ApplyFilter(Options& options, const std::vector< std::string >& directories)
+{
+   if (options.noExternal)
    {
-      cout << "Processing " << (*it) << endl;
-      release_structures();
+      for (size_t ix = 0; ix < directories.size(); ++ix)
+         options.filter.Internal(directories[ix]);
+      if (!options.baseDirectory.empty())
+         options.filter.Internal(options.baseDirectory);
+   }
+   SourceNames.SetFilter(&options.filter);
+}
+
+// ---------------------------------------------------------------------------
+// Print the sources filtered out by OPTIONS, with --stats
+void FilterStats(const Options& options)
+{
+   if (!options.filter.Empty())
+      fprintf(stderr, "Filter  : %u of %u sources excluded\n", (unsigned)SourceNames.ExcludedSize(), (unsigned)SourceNames.Size());
+}
 
-      process_file((*it));
+// ---------------------------------------------------------------------------
+// lcov++ convert: a tracefile to a binary coverage file, or the reverse
+int Convert(int argc, char* argv[])
+{
+   Options options;
+   if (!ParseOptions(argc, argv, options) || options.inputs.size() != 1)
+   {
+      Usage(argv[0]);
+      return 1;
    }
+   const std::string& input = options.inputs[0];
+   if (options.output == "-")
+      progress = &cerr;
+   ApplyFilter(options, std::vector< std::string >(1, "."));
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   SourceInfos infos;
+   bool binary;
+   if (!ReadCoverage(input, infos, binary))
+      return 1;
+   MergeInfos(infos);
+   infos = SourceInfos();
+   double readTime = Elapsed(start);
+
+   // To the other format, app.covb or app.info by default
+   if (!options.outputSet && !binary)
+      options.output = "app.covb";
+
+   start = std::chrono::steady_clock::now();
+   bool compress;
+   unsigned sources = 0;
+   if (!WriteCoverage(options, !binary, compress, sources))
+      return 1;
+   double writeTime = Elapsed(start);
 
-   const char* appInfoFilename = "app.info";
+   *progress << "Converted " << input << " to " << options.output << endl;
+   if (options.stats)
+   {
+      fprintf(stderr, "Read    : %.3f s (%s)\n", readTime, binary ? "binary" : "tracefile");
+      FilterStats(options);
+      fprintf(stderr, "Write   : %.3f s, %u sources (%s)\n", writeTime, sources, binary ? (compress ? "tracefile, gzip" : "tracefile") : "binary");
+   }
+   return 0;
+}
 
-   ofstream file(appInfoFilename);
-   for (std::map< std::string, Functions >::const_iterator it = SourceFunctions.begin(); it != SourceFunctions.end(); ++it)
+// ---------------------------------------------------------------------------
+// lcov++ merge, or -a: sum the coverage of the tracefiles of OPTIONS. They
+// are read by options.jobs threads and merged in their order, so the
+// result does not depend on the number of jobs.
+int Merge(const Options& options)
+{
+   const std::vector< std::string >& tracefiles = options.tracefiles;
+   const size_t count = tracefiles.size();
+   const unsigned jobs = std::max(1u, std::min< unsigned >(options.jobs, count));
+   const size_t window = 4 * jobs;
+
+   if (options.output == "-")
+      progress = &cerr;
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   std::vector< capture_result > results(count);
+   std::vector< char > failed(count, 0);
+   std::mutex mutex;
+   std::condition_variable read;   // a result is done
+   std::condition_variable merged; // a result is merged, a worker may go on
+   size_t next = 0;                // next file to read
+   size_t merging = 0;             // next result to merge
+
+   // Read the file IX in its result
+   auto readFile = [&](size_t ix)
    {
-      const Functions& functions = it->second;
+      bool binary;
+      notices = &results[ix].notices;
+      failed[ix] = !ReadCoverage(tracefiles[ix], results[ix].infos, binary);
+      notices = 0;
+   };
+
+   // With one job, the files are read by this thread
+   std::vector< std::thread > workers;
+   for (unsigned job = 0; jobs > 1 && job < jobs; ++job)
+      workers.push_back(std::thread([&]()
+      {
+         for (;;)
+         {
+            size_t ix;
+            {
+               std::unique_lock< std::mutex > lock(mutex);
+               merged.wait(lock, [&]() { return next >= count || next < merging + window; });
+               if (next >= count)
+                  break;
+               ix = next++;
+            }
 
-      // Header section
-      file << "TN:" << endl;
-      file << "SF:" << it->first << endl;
+            readFile(ix);
 
-      // FN section
-      size_t fnf = functions.size(); // function count
-      size_t fnh = 0; // function hit
-      for (Functions::const_iterator function = functions.begin(); function != functions.end(); ++function)
-         file << "FN:" << function->second.line << "," << function->first << endl;
+            std::lock_guard< std::mutex > lock(mutex);
+            results[ix].done = true;
+            read.notify_all();
+         }
+      }));
 
-      // FNDA section
-      for (Functions::const_iterator function = functions.begin(); function != functions.end(); ++function)
+   bool ok = true;
+   while (merging < count)
+   {
+      capture_result& result = results[merging];
+      if (workers.empty())
+         readFile(merging);
+      else
       {
-         if (function->second.hit) ++fnh;
-         file << "FNDA:" << function->second.hit << "," << function->first << endl;
+         std::unique_lock< std::mutex > lock(mutex);
+         read.wait(lock, [&]() { return result.done; });
       }
-      file << "FNF:" << fnf << endl;
-      file << "FNH:" << fnh << endl;
 
-      // BRDA section
-      std::map< std::string, Branches >::const_iterator foundBranches = SourceBranches.find(it->first);
-      if (foundBranches != SourceBranches.end())
-      {
-         const Branches& branches = foundBranches->second;
+      *progress << "Merging " << tracefiles[merging] << endl;
+      fputs(result.notices.c_str(), stderr);
+      ok = ok && !failed[merging];
+      MergeInfos(result.infos);
+      result = capture_result();
 
-         int brf = branches.size(); // # of branches found
-         int brh = 0; // # of branches hit
+      std::lock_guard< std::mutex > lock(mutex);
+      ++merging;
+      merged.notify_all();
+   }
 
-         for (std::map< BranchId, gcov_type >::const_iterator jt = branches.begin(); jt != branches.end(); ++jt)
-         {
-            if (jt->second) ++brh;
+   for (size_t ix = 0; ix < workers.size(); ++ix)
+      workers[ix].join();
+   double mergeTime = Elapsed(start);
 
-            file << "BRDA:" << jt->first.line << "," << jt->first.block << "," << jt->first.branch << ",";
-            if (jt->second < 0) file << '-';
-            else file << jt->second;
-            file << endl;
-         }
+   // Like lcov, a file which can't be read is an error
+   if (!ok)
+      return 1;
 
-         file << "BRF:" << brf << endl;
-         file << "BRH:" << brh << endl;
-      }
+   start = std::chrono::steady_clock::now();
+   bool binary = options.binary || EndsWith(options.output, ".covb");
+   bool compress;
+   unsigned sources = 0;
+   if (!WriteCoverage(options, binary, compress, sources))
+      return 1;
+   double writeTime = Elapsed(start);
+
+   *progress << "Finished " << options.output << " creation" << endl;
+   if (options.stats)
+   {
+      fprintf(stderr, "Merge   : %.3f s, %u files, %u job(s)\n", mergeTime, (unsigned)count, jobs);
+      FilterStats(options);
+      fprintf(stderr, "Write   : %.3f s, %u sources%s\n", writeTime, sources, binary ? ", binary" : compress ? ", gzip" : "");
+   }
+   return 0;
+}
+
+// --------------------------------------------------------------------------
+// One run for the command line ARGV: a capture, a merge or a conversion.
+// Called once by main, or for each request by a server.
+static
+int Run(int argc, char* argv[])
+{
+   // State left by the previous run of a server
+   progress = &cout;
+   stats.reset();
+
+   if (argc > 1 && !strcmp(argv[1], "convert"))
+   {
+      argv[1] = argv[0];
+      return Convert(argc - 1, argv + 1);
+   }
+   bool merge = argc > 1 && !strcmp(argv[1], "merge");
+   if (merge)
+   {
+      argv[1] = argv[0];
+      --argc;
+      ++argv;
+   }
+
+   Options options;
+   if (!ParseOptions(argc, argv, options))
+   {
+      Usage(argv[0]);
+      return 1;
+   }
+   if (!options.serve.empty() || !options.connect.empty())
+   {
+      cerr << "--serve and --connect are not allowed in a request" << endl;
+      return 1;
+   }
+   if (merge)
+      options.tracefiles.insert(options.tracefiles.end(), options.inputs.begin(), options.inputs.end());
+   if (merge || !options.tracefiles.empty())
+   {
+      // Tracefile paths are relative to the current directory
+      ApplyFilter(options, std::vector< std::string >(1, "."));
+      return Merge(options);
+   }
 
-      // DA section
-      std::map< std::string, Lines >::const_iterator foundLines = SourceLines.find(it->first);
-      if (foundLines != SourceLines.end())
+   // Data directories, .gcda files and lists of .gcda files
+   std::vector< std::string > directories, files, lists = options.lists;
+   for (size_t ix = 0; ix < options.inputs.size(); ++ix)
+   {
+      const std::string& input = options.inputs[ix];
+      if (input.size() > 1 && input[0] == '@')
+         lists.push_back(input.substr(1));
+      else if (EndsWith(input, GCOV_DATA_SUFFIX))
+         files.push_back(input);
+      else
+         directories.push_back(input);
+   }
+   if (directories.empty() && files.empty() && lists.empty())
+      directories.push_back(options.directory);
+
+   // The directories of the .gcno files are the internal ones
+   std::vector< std::string > internals = directories;
+   if (!options.buildDirectory.empty() || internals.empty())
+      internals.assign(1, options.buildDirectory.empty() ? std::string(".") : options.buildDirectory);
+   ApplyFilter(options, internals);
+#if GCOV_MMAP
+   gcov_mmap_enabled = options.mmap;
+#endif
+   flag_zero_path = options.zeroPath;
+   flag_check_cycles = options.checkCycles;
+   flag_log_cycles = options.logCycles;
+
+   // The cache of a server is used instead of --graph-cache
+   std::unique_ptr< GraphCache > graphCache;
+   graph_cache = server_graph_cache;
+   if (graph_cache)
+      graph_cache->ResetCounters();
+   else if (!options.graphCache.empty())
+   {
+      std::string error;
+      graphCache.reset(new GraphCache(options.graphCache, options.graphCacheSize * 1048576, 0));
+      if (!graphCache->Open(error))
       {
-         const Lines& lines = foundLines->second;
+         cerr << error << endl;
+         return 1;
+      }
+      graph_cache = graphCache.get();
+   }
 
-         int lf = lines.size(); // # of instrumented lines
-         int lh = 0; // # of lines with non zero execution count
-         for (std::map< int, int >::const_iterator jt = lines.begin(); jt != lines.end(); ++jt)
-         {
-            if (jt->second > 0) ++lh;
+   // Keep stdout for the tracefile
+   if (options.output == "-")
+      progress = &cerr;
 
-            file << "DA:" << jt->first << "," << jt->second << endl;
-         }
-         file << "LF:" << lf << endl;
-         file << "LH:" << lh << endl;
+   // The objects unchanged since the previous capture with the same filter
+   // reuse their contribution to it
+   std::unique_ptr< IncrementalState > incremental;
+   incremental_state = 0;
+   if (!options.incremental.empty())
+   {
+      incremental.reset(new IncrementalState());
+      std::string configuration = options.filter.Key(), reason;
+      if (!incremental->Load(options.incremental, configuration, reason))
+         *progress << "Capturing all the objects: " << reason << endl;
+      if (!incremental->Begin(options.incremental, configuration))
+      {
+         cerr << "cannot write " << options.incremental << endl;
+         return 1;
       }
+      incremental_state = incremental.get();
+   }
+
+   for (size_t ix = 0; ix < directories.size(); ++ix)
+      *progress << "Capturing coverage data from " << directories[ix] << endl;
+
+   // All filenames for the arc count data, by object, and their processing.
+   // With several jobs, the capture starts with the first objects found.
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   DirectoryWalker walker(GCOV_DATA_SUFFIX, options.jobs, options.follow, options.maxDepth);
+   capture_queue queue;
+   std::unique_ptr< Prefetcher > prefetcher(options.prefetch ? new Prefetcher(std::min(options.prefetch, 4u)) : 0);
+   size_t dataFiles = 0;
+   double scanTime = 0, captureTime;
+   if (options.jobs > 1)
+   {
+      std::thread scanner([&]()
+      {
+         ScanInputs(directories, files, lists, options.buildDirectory, walker, queue, dataFiles);
+         scanTime = Elapsed(start);
+      });
+      CaptureParallel(queue, options.jobs, prefetcher.get(), options.prefetch);
+      scanner.join();
+      captureTime = Elapsed(start);
+   }
+   else
+   {
+      ScanInputs(directories, files, lists, options.buildDirectory, walker, queue, dataFiles);
+      scanTime = Elapsed(start);
+      start = std::chrono::steady_clock::now();
+      CaptureSerial(queue, prefetcher.get(), options.prefetch);
+      captureTime = Elapsed(start);
+   }
+   if (graph_cache)
+      graph_cache->Trim();
+   incremental_state = 0;
+   if (incremental && !incremental->Commit())
+      cerr << "cannot write " << options.incremental << endl;
+
+   start = std::chrono::steady_clock::now();
+   const char* appInfoFilename = options.output.c_str();
+
+   unsigned sourcesWritten = 0;
+   bool binary = options.binary || EndsWith(options.output, ".covb");
+   bool compress;
+   if (!WriteCoverage(options, binary, compress, sourcesWritten))
+      return 1;
+   double writeTime = Elapsed(start);
+
+   *progress << "Finished " << appInfoFilename << " creation" << endl;
+
+   if (options.stats)
+   {
+      fprintf(stderr, "Scan    : %.3f s, %u files, %u objects, %llu directories, %llu entries\n", scanTime, (unsigned)dataFiles,
+              (unsigned)queue.objects.size(), walker.directories.load(), walker.entries.load());
+      fprintf(stderr, "Capture : %.3f s, %u job(s)%s\n", captureTime, options.jobs, options.jobs > 1 ? ", with the scan" : "");
+      fprintf(stderr, "  Read  : %.3f s, %u files (%s)\n", stats.read_time.load(), stats.files_read.load(), options.mmap ? "mmap" : "stdio");
+      fprintf(stderr, "  Solve : %.3f s, %u functions, %u with zero counts%s\n", stats.solve_time.load(),
+              stats.functions.load(), stats.zero_functions.load(), flag_zero_path ? "" : " (no fast path)");
+      fprintf(stderr, "  Lines : %llu cycle search iterations, at most %llu on a line\n", stats.cycle_iterations.load(), stats.cycle_max.load());
+      if (options.checkCycles)
+         fprintf(stderr, "  Check : %u lines checked against gcov, %u different\n", stats.cycle_checks.load(), stats.cycle_mismatches.load());
+      if (graph_cache)
+         fprintf(stderr, "  Cache : %u hits, %u misses, %u stored (%.1f MB), %u evicted\n", graph_cache->hits.load(), graph_cache->misses.load(),
+                 graph_cache->stored.load(), graph_cache->storedBytes.load() / 1048576.0, graph_cache->evicted.load());
+      if (server_graph_cache)
+         fprintf(stderr, "  Keep  : %u hits in memory, %.1f MB kept, %u dropped\n", server_graph_cache->memoryHits.load(),
+                 server_graph_cache->memorySize.load() / 1048576.0, server_graph_cache->memoryEvicted.load());
+      if (incremental)
+         fprintf(stderr, "  Reuse : %u objects unchanged, %u captured\n", incremental->reused.load(), incremental->captured.load());
+      if (prefetcher)
+         fprintf(stderr, "  Ahead : %.3f s, %u files read ahead, %u objects ahead, %u thread(s)\n",
+                 prefetcher->time.load(), prefetcher->files.load(), options.prefetch, prefetcher->Threads());
+      fprintf(stderr, "  Alloc : %llu allocations, %.1f MB, %llu chunks, %llu resets\n",
+              stats.allocations.load(), stats.allocated_bytes.load() / 1048576.0, stats.chunks.load(), stats.resets.load());
+      unsigned long long lookups = FunctionNames.lookups.load(), misses = FunctionNames.misses.load();
+      fprintf(stderr, "  Names : %llu lookups, %.1f%% hits, %llu symbols demangled to %u names\n",
+              lookups, lookups ? 100.0 * (lookups - misses) / lookups : 0.0, misses, (unsigned)FunctionNames.Size());
+      FilterStats(options);
+      fprintf(stderr, "Write   : %.3f s, %u sources%s\n", writeTime, sourcesWritten, binary ? ", binary" : compress ? ", gzip" : "");
+   }
+   return 0;
+}
+
+// --------------------------------------------------------------------------
+// lcov++ --serve S: run the requests of the clients on the socket S, keeping
+// the parsed graphs, the source table and the demangled names from one to
+// the next.
+static
+int ServeCaptures(int argc, char* argv[])
+{
+   Options options;
+   if (!ParseOptions(argc, argv, options) || !options.inputs.empty())
+   {
+      Usage(argv[0]);
+      return 1;
+   }
 
-      // Closing
-      file << "end_of_record" << endl;
+   // In memory, and on disk with --graph-cache
+   std::string error;
+   GraphCache graphCache(options.graphCache, options.graphCacheSize * 1048576, options.cacheMemory * 1048576);
+   if (!graphCache.Open(error))
+   {
+      cerr << error << endl;
+      return 1;
    }
+   server_graph_cache = &graphCache;
+
+   const std::string program = argv[0];
+   int status = Serve(options.serve, [&](const std::vector< std::string >& arguments)
+   {
+      std::vector< char* > args(1, const_cast< char* >(program.c_str()));
+      for (size_t ix = 0; ix < arguments.size(); ++ix)
+         args.push_back(const_cast< char* >(arguments[ix].c_str()));
+      args.push_back(0);
+
+      // The filter was the one of the request, the aggregate its result.
+      // Also before the request, in case the previous one failed with an
+      // exception.
+      auto reset = []()
+      {
+         notices = 0;
+         SourceNames.SetFilter(0);
+         Coverage = std::vector< SourceCoverage >();
+      };
+      reset();
+      int status = Run(args.size() - 1, &args[0]);
+      reset();
+      return status;
+   });
+   server_graph_cache = 0;
+   return status;
+}
 
-   cout << "Finished " << appInfoFilename << " creation" << endl;
+// --------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+   for (int ix = 1; ix < argc; ++ix)
+   {
+      int next = ix;
+      const char* value;
+      if ((value = OptionValue(argc, argv, next, 0, "--connect")))
+      {
+         // Client of a server: the other arguments are its request
+         std::vector< std::string > arguments(argv + 1, argv + ix);
+         arguments.insert(arguments.end(), argv + next + 1, argv + argc);
+         return Connect(value, arguments);
+      }
+      if (OptionValue(argc, argv, next, 0, "--serve"))
+         return ServeCaptures(argc, argv);
+   }
+   return Run(argc, argv);
 }
 
 // --------------------------------------------------------------------------
@@ -423,82 +1549,126 @@ fnotice(FILE* file, const char* cmsgid, ...)
    va_list ap;
 
    va_start(ap, cmsgid);
-   vfprintf(file, (cmsgid), ap);
+   if (notices && file == stderr)
+   {
+      // Formatted in place, whatever its length
+      va_list copy;
+      va_copy(copy, ap);
+      const int length = vsnprintf(0, 0, cmsgid, copy);
+      va_end(copy);
+      if (length > 0)
+      {
+         const size_t size = notices->size();
+         notices->resize(size + length + 1);
+         vsnprintf(&(*notices)[size], length + 1, cmsgid, ap);
+         notices->resize(size + length);
+      }
+   }
+   else
+      vfprintf(file, (cmsgid), ap);
    va_end(ap);
 }
 
 // --------------------------------------------------------------------------
 // Process a single source file.
 static
-void process_file(const std::string& gcdaFilename)
+void process_file(object_info* obj, const capture_object& object, SourceInfos& infos)
 {
    // Filename for the basic block graph.
-   std::string gcnoFilename = createGCNOfilename(gcdaFilename);
-   if (read_graph_file(gcnoFilename))
+   const std::string& gcnoFilename = object.gcno;
+   // Reader of the graph then count files, only used by this thread.
+   struct gcov_var reader = {};
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   int error = read_graph(obj, &reader, gcnoFilename);
+   stats.files_read++;
+   if (error)
+   {
+      AddElapsed(stats.read_time, start);
       return;
+   }
 
-   if (!functions)
+   if (!obj->functions)
    {
+      AddElapsed(stats.read_time, start);
       fnotice(stderr, "%s:no functions found\n", gcnoFilename.c_str());
       return;
    }
 
-   if (read_count_file(gcdaFilename))
+   // The counters of all the data files are summed, an error in any of
+   // them drops the object
+   for (size_t ix = 0; ix < object.gcdas.size() && !error; ++ix)
+   {
+      error = read_count_file(obj, &reader, object.gcdas[ix]);
+      stats.files_read++;
+   }
+   AddElapsed(stats.read_time, start);
+   if (error)
       return;
 
-   for (function_info* fn = functions; fn; fn = fn->next)
-      solve_flow_graph(fn, gcnoFilename);
+   start = std::chrono::steady_clock::now();
+   for (function_info* fn = obj->functions; fn; fn = fn->next)
+   {
+      solve_flow_graph(obj, fn, gcnoFilename);
+      stats.functions++;
+      if (!fn->executed)
+         stats.zero_functions++;
+   }
 
-   for (source_info* src = sources; src; src = src->next)
-      src->lines = (line_info*)calloc(src->num_lines, sizeof(line_info));
+   for (source_info* src = obj->sources; src; src = src->next)
+   {
+      if (src->excluded)
+         continue;
+      src->lines = obj->arena.Alloc< line_info >(src->num_lines);
+      for (unsigned ix = 0; ix != src->num_lines; ix++)
+         src->lines[ix].u.blocks = NO_INDEX;
+   }
 
-   for (function_info* fn = functions; fn; fn = fn->next)
-      add_line_counts(fn, gcnoFilename);
+   for (function_info* fn = obj->functions; fn; fn = fn->next)
+      add_line_counts(obj, fn, gcnoFilename);
 
-   for (source_info* src = sources; src; src = src->next)
+   for (source_info* src = obj->sources; src; src = src->next)
    {
-      accumulate_line_counts(src);
+      if (src->excluded)
+         continue;
+      accumulate_line_counts(obj, src);
       //function_summary (&src->coverage, "File");
 
-      aggregate_info(src);
+      aggregate_info(obj, src, infos);
    }
+   AddElapsed(stats.solve_time, start);
 }
 
 // --------------------------------------------------------------------------
 // Release all memory used.
 static
-void release_structures()
+void release_structures(object_info* obj)
 {
-   bbg_file_time = 0;
-   gcno_stamp = 0;
+   obj->bbg_file_time = 0;
+   obj->gcno_stamp = 0;
 
    source_info* src;
-   while ((src = sources))
+   while ((src = obj->sources))
    {
-      sources = src->next;
-      free(src->lines);
+      obj->sources = src->next;
+      obj->source_ids[src->id] = NULL;
+      delete src;
    }
 
-   function_info* fn;
-   while ((fn = functions))
-   {
-      unsigned ix;
-      block_info* block;
-
-      functions = fn->next;
-      for (ix = fn->num_blocks, block = fn->blocks; ix--; block++)
-      {
-         arc_info* arc, *arc_n;
-
-         for (arc = block->succ; arc; arc = arc_n)
-         {
-            arc_n = arc->succ_next;
-            free(arc);
-         }
-      }
-      free(fn->blocks);
-      free(fn->counts);
-   }
+   obj->source_index.clear();
+   obj->source_names.clear();
+   obj->line_encodings.clear();
+   obj->functions = 0;
+   obj->ident_index.clear();
+   obj->ident_map.clear();
+   obj->blocks.clear();
+   obj->arcs.clear();
+   obj->cycle_state.clear();
+   obj->cycle_blocked_by.clear();
+   obj->cycle_pool.clear();
+   obj->cycle_touched.clear();
+   obj->cycle_unblocking.clear();
+   obj->arena.Reset();
 }
 
 // --------------------------------------------------------------------------
@@ -521,76 +1691,132 @@ std::string createGCNOfilename(const std::string& gcdaFilename)
 }
 
 // --------------------------------------------------------------------------
-// Find or create a source file structure for FILE_NAME. Copies FILE_NAME on creation
+// Find or create a source file structure for FILE_NAME, relative to the
+// directory of the graph file, through the interned source table.
 // --------------------------------------------------------------------------
 static
-source_info* find_source(const char* file_name, const std::string& gcnoFilename)
+source_info* find_source(object_info* obj, const char* file_name)
 {
-   source_info* src = 0;
-
    if (!file_name)
       file_name = "<unknown>";
 
-   // Extract the directory from gcno filename
-   std::string filename = file_name;
-   if (filename[0] != '/')
-   {
-      // only for not absolute path
-      size_t position = gcnoFilename.rfind('/');
-      if (position != std::string::npos)
-         filename = gcnoFilename.substr(0, position + 1) + filename;
-   }
-
-   // Reduce the path
-   size_t found;
-   while ((found = filename.find("/../")) != std::string::npos)
-   {
-      size_t before = filename.rfind('/', found - 1);
-      if (before != std::string::npos)
-         filename.erase(before, found - before + 3);
-      else
-         break; // Oups ???
-   }
+   SourceId id = SourceNames.Intern(obj->directory, file_name);
+   if (id >= obj->source_ids.size())
+      obj->source_ids.resize(id + 1, NULL);
 
-   for (src = sources; src; src = src->next)
-      if (filename == src->name)
-         return src;
+   source_info* src = obj->source_ids[id];
+   if (src)
+      return src;
 
    src = new source_info();
-   src->name = filename;
-   src->coverage.name = src->name;
-   src->index = sources ? sources->index + 1 : 1;
-   src->next = sources;
-   sources = src;
+   src->id = id;
+   src->excluded = SourceNames.Excluded(id);
+   src->index = obj->source_index.size();
+   src->next = obj->sources;
+   obj->sources = src;
+   obj->source_ids[id] = src;
+   obj->source_index.push_back(src);
+   obj->source_names.push_back(file_name);
 
    return src;
 }
 
+// --------------------------------------------------------------------------
+// Set the directory of the graph file GCNOFILENAME, with its trailing '/',
+// to which the relative source names are relative.
+// --------------------------------------------------------------------------
+static
+void set_graph_directory(object_info* obj, const std::string& gcnoFilename)
+{
+   size_t position = gcnoFilename.rfind('/');
+   if (position != std::string::npos)
+      obj->directory.assign(gcnoFilename, 0, position + 1);
+   else
+      obj->directory.clear();
+}
+
+// --------------------------------------------------------------------------
+// Insert FN into the list of functions of SRC, in descending line order.
+// Normally functions will be encountered in ascending order, so a simple
+// scan is quick.
+// --------------------------------------------------------------------------
+static
+void insert_function(source_info* src, function_info* fn)
+{
+   function_info* probe, * prev;
+   for (probe = src->functions, prev = NULL;
+         probe && probe->line > fn->line;
+         prev = probe, probe = probe->line_next)
+      continue;
+   fn->line_next = probe;
+   if (prev)
+      prev->line_next = fn;
+   else
+      src->functions = fn;
+}
+
+// --------------------------------------------------------------------------
+// Read the graph of GCNOFILENAME from the graph cache if its entry is up to
+// date, else from the graph file, then store it in the cache. Return
+// nonzero on fatal error.
+// --------------------------------------------------------------------------
+static
+int read_graph(object_info* obj, struct gcov_var* reader, const std::string& gcnoFilename)
+{
+   if (!graph_cache)
+      return read_graph_file(obj, reader, gcnoFilename);
+
+   GraphKey key;
+   {
+      GraphEntry entry;
+      if (graph_cache->Find(gcnoFilename, key, entry))
+      {
+         const bool used = !read_graph_cache(obj, entry.data, entry.size, key, gcnoFilename);
+         graph_cache->Used(entry, used);
+         if (used)
+            return 0;
+         // Not from this build: parsed again, and replaced
+         release_structures(obj);
+      }
+   }
+
+   int error = read_graph_file(obj, reader, gcnoFilename);
+
+   // Unless the graph file changed since its key was read
+   if (!error && key.valid && obj->gcno_stamp == key.stamp && obj->bbg_file_time == key.seconds)
+   {
+      static thread_local std::string data;
+      write_graph_cache(obj, data);
+      graph_cache->Store(key, data);
+   }
+   return error;
+}
+
 // --------------------------------------------------------------------------
 // Read the graph file. Return nonzero on fatal error.
 // --------------------------------------------------------------------------
 static
-int read_graph_file(const std::string& gcnoFilename)
+int read_graph_file(object_info* obj, struct gcov_var* reader, const std::string& gcnoFilename)
 {
    unsigned version;
    unsigned current_tag = 0;
    struct function_info* fn = NULL;
    source_info* src = NULL;
 
-   if (!gcov_open(gcnoFilename.c_str(), 1))
+   if (!gcov_open_r(reader, gcnoFilename.c_str(), 1))
    {
       fnotice(stderr, "%s:cannot open graph file\n", gcnoFilename.c_str());
       return 1;
    }
-   bbg_file_time = gcov_time();
-   if (!gcov_magic(gcov_read_unsigned(), GCOV_NOTE_MAGIC))
+   obj->bbg_file_time = gcov_time_r(reader);
+   if (!gcov_magic_r(reader, gcov_read_unsigned_r(reader), GCOV_NOTE_MAGIC))
    {
       fnotice(stderr, "%s:not a gcov graph file\n", gcnoFilename.c_str());
-      gcov_close();
+      gcov_close_r(reader);
       return 1;
    }
 
-   version = gcov_read_unsigned();
+   version = gcov_read_unsigned_r(reader);
    if (version != GCOV_VERSION)
    {
       char v[4], e[4];
@@ -600,81 +1826,84 @@ int read_graph_file(const std::string& gcnoFilename)
 
       //fnotice (stderr, "%s:version '%.4s', prefer '%.4s'\n", gcnoFilename.c_str(), v, e);
    }
-   gcno_stamp = gcov_read_unsigned();
+   obj->gcno_stamp = gcov_read_unsigned_r(reader);
+   set_graph_directory(obj, gcnoFilename);
 
    unsigned tag;
-   while ((tag = gcov_read_unsigned()))
+   while ((tag = gcov_read_unsigned_r(reader)))
    {
-      unsigned length = gcov_read_unsigned();
-      gcov_position_t base = gcov_position();
+      unsigned length = gcov_read_unsigned_r(reader);
+      gcov_position_t base = gcov_position_r(reader);
 
       if (tag == GCOV_TAG_FUNCTION)
       {
-         unsigned ident = gcov_read_unsigned();
-         unsigned checksum = gcov_read_unsigned();
-         char* function_name = strdup(gcov_read_string());
-         source_info* src = find_source(gcov_read_string(), gcnoFilename);
-         unsigned lineno = gcov_read_unsigned();
+         unsigned ident = gcov_read_unsigned_r(reader);
+         unsigned checksum = gcov_read_unsigned_r(reader);
+         char* function_name = obj->arena.StrDup(gcov_read_string_r(reader));
+         source_info* src = find_source(obj, gcov_read_string_r(reader));
+         unsigned lineno = gcov_read_unsigned_r(reader);
 
-         fn = (function_info*)calloc(1, sizeof(function_info));
+         fn = obj->arena.Alloc< function_info >(1);
          fn->name = function_name;
          fn->ident = ident;
          fn->checksum = checksum;
          fn->src = src;
          fn->line = lineno;
 
-         fn->next = functions;
-         functions = fn;
+         fn->next = obj->functions;
+         obj->functions = fn;
          current_tag = tag;
 
          if (lineno >= src->num_lines)
             src->num_lines = lineno + 1;
-         // Now insert it into the source file's list of
-         // functions. Normally functions will be encountered in
-         // ascending order, so a simple scan is quick.
-         function_info* probe, * prev;
-         for (probe = src->functions, prev = NULL;
-               probe && probe->line > lineno;
-               prev = probe, probe = probe->line_next)
-            continue;
-         fn->line_next = probe;
-         if (prev)
-            prev->line_next = fn;
-         else
-            src->functions = fn;
+         insert_function(src, fn);
       }
       else if (fn && tag == GCOV_TAG_BLOCKS)
       {
-         if (fn->blocks)
+         if (fn->num_blocks)
             fnotice(stderr, "%s:already seen blocks for '%s'\n", gcnoFilename.c_str(), fn->name);
          else
          {
             unsigned num_blocks = GCOV_TAG_BLOCKS_NUM(length);
+            fn->first_block = obj->blocks.size();
             fn->num_blocks = num_blocks;
 
-            fn->blocks = (block_info*)calloc(fn->num_blocks, sizeof(block_info));
+            obj->blocks.resize(fn->first_block + num_blocks, block_info());
             for (unsigned ix = 0; ix != num_blocks; ix++)
-               fn->blocks[ix].flags = gcov_read_unsigned();
+            {
+               obj->blocks[fn->first_block + ix].flags = gcov_read_unsigned_r(reader);
+               obj->blocks[fn->first_block + ix].u.line.first = NO_INDEX;
+            }
          }
       }
       else if (fn && tag == GCOV_TAG_ARCS)
       {
-         unsigned src = gcov_read_unsigned();
+         unsigned src = gcov_read_unsigned_r(reader);
          unsigned num_dests = GCOV_TAG_ARCS_NUM(length);
 
-         if (src >= fn->num_blocks || fn->blocks[src].succ)
+         if (src >= fn->num_blocks || obj->blocks[fn->first_block + src].num_succ)
+            goto corrupt;
+
+         if (!fn->num_arcs)
+            fn->first_arc = obj->arcs.size();
+         else if (fn->first_arc + fn->num_arcs != obj->arcs.size())
             goto corrupt;
 
+         block_info* src_block = &obj->blocks[fn->first_block + src];
          while (num_dests--)
          {
-            unsigned dest = gcov_read_unsigned();
-            unsigned flags = gcov_read_unsigned();
+            unsigned dest = gcov_read_unsigned_r(reader);
+            unsigned flags = gcov_read_unsigned_r(reader);
 
             if (dest >= fn->num_blocks)
                goto corrupt;
-            struct arc_info* arc = (arc_info*)calloc(1, sizeof(arc_info));
-            arc->dst = &fn->blocks[dest];
-            arc->src = &fn->blocks[src];
+            block_info* dst_block = &obj->blocks[fn->first_block + dest];
+
+            obj->arcs.push_back(arc_info());
+            fn->num_arcs++;
+            struct arc_info* arc = &obj->arcs.back();
+            arc->dst = fn->first_block + dest;
+            arc->src = fn->first_block + src;
 
             arc->count = 0;
             arc->count_valid = 0;
@@ -682,13 +1911,8 @@ int read_graph_file(const std::string& gcnoFilename)
             arc->fake = !!(flags & GCOV_ARC_FAKE);
             arc->fall_through = !!(flags & GCOV_ARC_FALLTHROUGH);
 
-            arc->succ_next = fn->blocks[src].succ;
-            fn->blocks[src].succ = arc;
-            fn->blocks[src].num_succ++;
-
-            arc->pred_next = fn->blocks[dest].pred;
-            fn->blocks[dest].pred = arc;
-            fn->blocks[dest].num_pred++;
+            src_block->num_succ++;
+            dst_block->num_pred++;
 
             if (arc->fake)
             {
@@ -696,7 +1920,7 @@ int read_graph_file(const std::string& gcnoFilename)
                {
                   // Exceptional exit from this function, the
                   // source block must be a call.
-                  fn->blocks[src].is_call_site = 1;
+                  src_block->is_call_site = 1;
                   arc->is_call_non_return = 1;
                }
                else
@@ -705,7 +1929,7 @@ int read_graph_file(const std::string& gcnoFilename)
                   // function. The destination block is a catch or
                   // setjmp.
                   arc->is_nonlocal_return = 1;
-                  fn->blocks[dest].is_nonlocal_return = 1;
+                  dst_block->is_nonlocal_return = 1;
                }
             }
 
@@ -715,119 +1939,377 @@ int read_graph_file(const std::string& gcnoFilename)
       }
       else if (fn && tag == GCOV_TAG_LINES)
       {
-         unsigned blockno = gcov_read_unsigned();
-         unsigned* line_nos = (unsigned*)calloc(length - 1, sizeof(unsigned));
+         unsigned blockno = gcov_read_unsigned_r(reader);
 
-         if (blockno >= fn->num_blocks || fn->blocks[blockno].u.line.encoding)
+         if (blockno >= fn->num_blocks || obj->blocks[fn->first_block + blockno].u.line.first != NO_INDEX)
             goto corrupt;
 
-         unsigned ix = 0;
-         for (ix = 0; ;)
+         std::vector< unsigned >& line_nos = obj->line_encodings;
+         unsigned first = line_nos.size();
+         for (;;)
          {
-            unsigned lineno = gcov_read_unsigned();
+            unsigned lineno = gcov_read_unsigned_r(reader);
 
             if (lineno)
             {
-               if (!ix)
+               if (line_nos.size() == first)
                {
-                  line_nos[ix++] = 0;
-                  line_nos[ix++] = src->index;
+                  line_nos.push_back(0);
+                  line_nos.push_back(src->index);
                }
-               line_nos[ix++] = lineno;
+               line_nos.push_back(lineno);
                if (lineno >= src->num_lines)
                   src->num_lines = lineno + 1;
             }
             else
             {
-               const char* file_name = gcov_read_string();
+               const char* file_name = gcov_read_string_r(reader);
                if (!file_name)
                   break;
 
-               src = find_source(file_name, gcnoFilename);
+               src = find_source(obj, file_name);
 
-               line_nos[ix++] = 0;
-               line_nos[ix++] = src->index;
+               line_nos.push_back(0);
+               line_nos.push_back(src->index);
             }
          }
 
-         fn->blocks[blockno].u.line.encoding = line_nos;
-         fn->blocks[blockno].u.line.num = ix;
-      }
-      else if (current_tag && !GCOV_TAG_IS_SUBTAG(current_tag, tag))
-      {
-         fn = NULL;
-         current_tag = 0;
-      }
-      gcov_sync(base, length);
-      if (gcov_is_error())
-      {
-corrupt:
-         ;
-         fnotice(stderr, "%s:corrupted\n", gcnoFilename.c_str());
-         gcov_close();
+         obj->blocks[fn->first_block + blockno].u.line.first = first;
+         obj->blocks[fn->first_block + blockno].u.line.num = line_nos.size() - first;
+      }
+      else if (current_tag && !GCOV_TAG_IS_SUBTAG(current_tag, tag))
+      {
+         fn = NULL;
+         current_tag = 0;
+      }
+      gcov_sync_r(reader, base, length);
+      if (gcov_is_error_r(reader))
+      {
+corrupt:
+         ;
+         fnotice(stderr, "%s:corrupted\n", gcnoFilename.c_str());
+         gcov_close_r(reader);
+         return 1;
+      }
+   }
+   gcov_close_r(reader);
+
+   // We built everything backwards, so nreverse them all.
+
+   // Reverse sources. Not strictly necessary, but we'll then process
+   // them in the 'expected' order.
+   {
+      source_info* src, *src_p, *src_n;
+
+      for (src_p = NULL, src = obj->sources; src; src_p = src, src = src_n)
+      {
+         src_n = src->next;
+         src->next = src_p;
+      }
+      obj->sources =  src_p;
+   }
+
+   // Reverse functions.
+   {
+      function_info* fn, *fn_p, *fn_n;
+
+      for (fn_p = NULL, fn = obj->functions; fn; fn_p = fn, fn = fn_n)
+      {
+         fn_n = fn->next;
+         fn->next = fn_p;
+      }
+      obj->functions = fn_p;
+   }
+
+   build_arc_index(obj);
+   build_ident_index(obj);
+   return 0;
+}
+
+// --------------------------------------------------------------------------
+// Read the graph of GCNOFILENAME from the content of its graph cache entry,
+// DATA of SIZE bytes. The arrays are copied as they are, only the sources,
+// functions and ident index are rebuilt. Return nonzero if the content is
+// not valid.
+// --------------------------------------------------------------------------
+static
+int read_graph_cache(object_info* obj, const char* data, size_t size, const GraphKey& key, const std::string& gcnoFilename)
+{
+   if (size < sizeof(graph_cache_header))
+      return 1;
+   const graph_cache_header* header = reinterpret_cast< const graph_cache_header* >(data);
+   if (header->magic != GRAPH_CACHE_MAGIC || header->version != GRAPH_CACHE_VERSION
+         || header->block_size != sizeof(block_info) || header->arc_size != sizeof(arc_info))
+      return 1;
+
+   const unsigned num_blocks = header->num_blocks;
+   const unsigned num_arcs = header->num_arcs;
+   const unsigned num_sources = header->num_sources;
+
+   // Sections
+   size_t offset = sizeof(graph_cache_header);
+   auto section = [&](size_t count, size_t element) -> const char*
+   {
+      const char* start = data + offset;
+      if (offset > size || count > (size - offset) / element)
+         return NULL;
+      offset = (offset + count * element + 7) & ~(size_t)7;
+      return start;
+   };
+   const graph_cache_function* functions = reinterpret_cast< const graph_cache_function* >(section(header->num_functions, sizeof(graph_cache_function)));
+   const graph_cache_source* sources = reinterpret_cast< const graph_cache_source* >(section(num_sources, sizeof(graph_cache_source)));
+   const block_info* blocks = reinterpret_cast< const block_info* >(section(num_blocks, sizeof(block_info)));
+   const arc_info* arcs = reinterpret_cast< const arc_info* >(section(num_arcs, sizeof(arc_info)));
+   const unsigned* encodings = reinterpret_cast< const unsigned* >(section(header->num_encodings, sizeof(unsigned)));
+   const unsigned* succ_index = reinterpret_cast< const unsigned* >(section(num_blocks + 1, sizeof(unsigned)));
+   const unsigned* succ_arcs = reinterpret_cast< const unsigned* >(section(num_arcs, sizeof(unsigned)));
+   const unsigned* pred_index = reinterpret_cast< const unsigned* >(section(num_blocks + 1, sizeof(unsigned)));
+   const unsigned* pred_arcs = reinterpret_cast< const unsigned* >(section(num_arcs, sizeof(unsigned)));
+   const char* strings = section(header->strings_size, 1);
+   if (!functions || !sources || !blocks || !arcs || !encodings || !succ_index || !succ_arcs || !pred_index || !pred_arcs || !strings
+         || (header->strings_size && strings[header->strings_size - 1]))
+      return 1;
+
+   // The indices are checked, so that a damaged entry can't be followed
+   // out of the arrays
+   for (unsigned ix = 0; ix != num_arcs; ix++)
+      if (arcs[ix].src >= num_blocks || arcs[ix].dst >= num_blocks || succ_arcs[ix] >= num_arcs || pred_arcs[ix] >= num_arcs)
+         return 1;
+   for (unsigned ix = 0; ix != num_blocks; ix++)
+      if (succ_index[ix] > succ_index[ix + 1] || pred_index[ix] > pred_index[ix + 1]
+            || (blocks[ix].u.line.first != NO_INDEX
+                && (blocks[ix].u.line.first > header->num_encodings || blocks[ix].u.line.num > header->num_encodings - blocks[ix].u.line.first)))
+         return 1;
+   if (succ_index[num_blocks] != num_arcs || pred_index[num_blocks] != num_arcs)
+      return 1;
+   for (unsigned ix = 0; ix < header->num_encodings; ix++)
+      if (!encodings[ix] && (++ix == header->num_encodings || encodings[ix] >= num_sources))
          return 1;
-      }
-   }
-   gcov_close();
 
-   // We built everything backwards, so nreverse them all.
+   obj->bbg_file_time = key.seconds;
+   obj->gcno_stamp = header->stamp;
+   set_graph_directory(obj, gcnoFilename);
 
-   // Reverse sources. Not strictly necessary, but we'll then process
-   // them in the 'expected' order.
+   // Sources, created in index order as they were by the graph file
+   for (unsigned ix = 0; ix != num_sources; ix++)
+   {
+      if (sources[ix].name >= header->strings_size)
+         return 1;
+      source_info* src = find_source(obj, strings + sources[ix].name);
+      if (src->index != ix)
+         return 1;
+      src->num_lines = sources[ix].num_lines;
+   }
    {
       source_info* src, *src_p, *src_n;
 
-      for (src_p = NULL, src = sources; src; src_p = src, src = src_n)
+      for (src_p = NULL, src = obj->sources; src; src_p = src, src = src_n)
       {
          src_n = src->next;
          src->next = src_p;
       }
-      sources =  src_p;
+      obj->sources =  src_p;
    }
 
-   // Reverse functions.
+   // Functions, in graph file order
+   function_info** last = &obj->functions;
+   for (unsigned ix = 0; ix != header->num_functions; ix++)
    {
-      function_info* fn, *fn_p, *fn_n;
+      const graph_cache_function& cached = functions[ix];
+      if (cached.name >= header->strings_size || cached.source >= num_sources
+            || cached.first_block > num_blocks || cached.num_blocks > num_blocks - cached.first_block
+            || cached.first_arc > num_arcs || cached.num_arcs > num_arcs - cached.first_arc)
+         return 1;
 
-      for (fn_p = NULL, fn = functions; fn; fn_p = fn, fn = fn_n)
-      {
-         unsigned ix;
+      function_info* fn = obj->arena.Alloc< function_info >(1);
+      fn->name = obj->arena.StrDup(strings + cached.name);
+      fn->ident = cached.ident;
+      fn->checksum = cached.checksum;
+      fn->line = cached.line;
+      fn->src = obj->source_index[cached.source];
+      fn->first_block = cached.first_block;
+      fn->num_blocks = cached.num_blocks;
+      fn->first_arc = cached.first_arc;
+      fn->num_arcs = cached.num_arcs;
+      fn->num_counts = cached.num_counts;
+
+      *last = fn;
+      last = &fn->next;
+      insert_function(fn->src, fn);
+   }
 
-         fn_n = fn->next;
-         fn->next = fn_p;
+   obj->blocks.assign(blocks, blocks + num_blocks);
+   obj->arcs.assign(arcs, arcs + num_arcs);
+   obj->line_encodings.assign(encodings, encodings + header->num_encodings);
+   obj->succ_index.assign(succ_index, succ_index + num_blocks + 1);
+   obj->succ_arcs.assign(succ_arcs, succ_arcs + num_arcs);
+   obj->pred_index.assign(pred_index, pred_index + num_blocks + 1);
+   obj->pred_arcs.assign(pred_arcs, pred_arcs + num_arcs);
 
-         // Reverse the arcs.
-         for (ix = fn->num_blocks; ix--;)
-         {
-            arc_info* arc, *arc_p, *arc_n;
+   build_ident_index(obj);
+   return 0;
+}
 
-            for (arc_p = NULL, arc = fn->blocks[ix].succ; arc;
-                  arc_p = arc, arc = arc_n)
-            {
-               arc_n = arc->succ_next;
-               arc->succ_next = arc_p;
-            }
-            fn->blocks[ix].succ = arc_p;
+// --------------------------------------------------------------------------
+// Append the COUNT elements of ARRAY to DATA, then pad it to 8 bytes.
+// --------------------------------------------------------------------------
+template< class T >
+static
+void append_section(std::string& data, const T* array, size_t count)
+{
+   data.append(reinterpret_cast< const char* >(array), count * sizeof(T));
+   data.resize((data.size() + 7) & ~(size_t)7, '\0');
+}
 
-            for (arc_p = NULL, arc = fn->blocks[ix].pred; arc;
-                  arc_p = arc, arc = arc_n)
-            {
-               arc_n = arc->pred_next;
-               arc->pred_next = arc_p;
-            }
-            fn->blocks[ix].pred = arc_p;
-         }
+// --------------------------------------------------------------------------
+// Content of the graph cache entry of the object, as just read from its
+// graph file, into DATA.
+// --------------------------------------------------------------------------
+static
+void write_graph_cache(const object_info* obj, std::string& data)
+{
+   static thread_local std::string strings;
+   static thread_local std::vector< graph_cache_function > functions;
+   static thread_local std::vector< graph_cache_source > sources;
+   strings.clear();
+   functions.clear();
+   sources.clear();
+
+   for (size_t ix = 0; ix != obj->source_index.size(); ix++)
+   {
+      graph_cache_source cached = { (unsigned)strings.size(), obj->source_index[ix]->num_lines };
+      sources.push_back(cached);
+      strings.append(obj->source_names[ix].c_str(), obj->source_names[ix].size() + 1);
+   }
+   for (const function_info* fn = obj->functions; fn; fn = fn->next)
+   {
+      graph_cache_function cached = { (unsigned)strings.size(), fn->src->index, fn->ident, fn->checksum, fn->line,
+                                      fn->first_block, fn->num_blocks, fn->first_arc, fn->num_arcs, fn->num_counts };
+      functions.push_back(cached);
+      strings.append(fn->name, strlen(fn->name) + 1);
+   }
+
+   graph_cache_header header;
+   memset(&header, 0, sizeof(header));
+   header.magic = GRAPH_CACHE_MAGIC;
+   header.version = GRAPH_CACHE_VERSION;
+   header.block_size = sizeof(block_info);
+   header.arc_size = sizeof(arc_info);
+   header.stamp = obj->gcno_stamp;
+   header.num_functions = functions.size();
+   header.num_sources = sources.size();
+   header.num_blocks = obj->blocks.size();
+   header.num_arcs = obj->arcs.size();
+   header.num_encodings = obj->line_encodings.size();
+   header.strings_size = strings.size();
+
+   data.clear();
+   append_section(data, &header, 1);
+   append_section(data, functions.data(), functions.size());
+   append_section(data, sources.data(), sources.size());
+   append_section(data, obj->blocks.data(), obj->blocks.size());
+   append_section(data, obj->arcs.data(), obj->arcs.size());
+   append_section(data, obj->line_encodings.data(), obj->line_encodings.size());
+   append_section(data, obj->succ_index.data(), obj->succ_index.size());
+   append_section(data, obj->succ_arcs.data(), obj->succ_arcs.size());
+   append_section(data, obj->pred_index.data(), obj->pred_index.size());
+   append_section(data, obj->pred_arcs.data(), obj->pred_arcs.size());
+   append_section(data, strings.data(), strings.size());
+}
+
+// --------------------------------------------------------------------------
+// Build the CSR index arrays of the successor and predecessor arcs of each
+// block. Both keep the graph file order of the arcs, which is the order in
+// which the counts are given.
+// --------------------------------------------------------------------------
+static
+void build_arc_index(object_info* obj)
+{
+   unsigned num_blocks = obj->blocks.size();
+   unsigned num_arcs = obj->arcs.size();
+
+   obj->succ_index.assign(num_blocks + 1, 0);
+   obj->pred_index.assign(num_blocks + 1, 0);
+   obj->succ_arcs.resize(num_arcs);
+   obj->pred_arcs.resize(num_arcs);
+
+   // Count the arcs of each block B in [B + 1], then turn the counts into
+   // the start of the slice of B, still in [B + 1].
+   for (unsigned ix = 0; ix != num_arcs; ix++)
+   {
+      obj->succ_index[obj->arcs[ix].src + 1]++;
+      obj->pred_index[obj->arcs[ix].dst + 1]++;
+   }
+   unsigned succ_start = 0, pred_start = 0;
+   for (unsigned ix = 1; ix != num_blocks + 1; ix++)
+   {
+      unsigned succ_count = obj->succ_index[ix];
+      unsigned pred_count = obj->pred_index[ix];
+      obj->succ_index[ix] = succ_start;
+      obj->pred_index[ix] = pred_start;
+      succ_start += succ_count;
+      pred_start += pred_count;
+   }
+
+   // Fill the slices: [B + 1] is the fill position of block B, and ends up
+   // at the end of B's slice, which is the start of B + 1.
+   for (unsigned ix = 0; ix != num_arcs; ix++)
+   {
+      obj->succ_arcs[obj->succ_index[obj->arcs[ix].src + 1]++] = ix;
+      obj->pred_arcs[obj->pred_index[obj->arcs[ix].dst + 1]++] = ix;
+   }
+}
+
+// --------------------------------------------------------------------------
+// Build the ident index of the functions. The vector covers the idents up
+// to a few times the number of functions, larger ones go to the hash. If an
+// ident is given twice, the first function in the graph file order wins.
+// --------------------------------------------------------------------------
+static
+void build_ident_index(object_info* obj)
+{
+   unsigned num_functions = 0;
+   for (function_info* fn = obj->functions; fn; fn = fn->next)
+      num_functions++;
+
+   unsigned dense_limit = 4 * num_functions + 64;
+   unsigned max_ident = 0;
+   for (function_info* fn = obj->functions; fn; fn = fn->next)
+      if (fn->ident < dense_limit && fn->ident >= max_ident)
+         max_ident = fn->ident + 1;
+
+   obj->ident_index.assign(max_ident, NULL);
+   obj->ident_map.clear();
+   for (function_info* fn = obj->functions; fn; fn = fn->next)
+   {
+      if (fn->ident < max_ident)
+      {
+         if (!obj->ident_index[fn->ident])
+            obj->ident_index[fn->ident] = fn;
       }
-      functions = fn_p;
+      else
+         obj->ident_map.insert(std::make_pair(fn->ident, fn));
    }
-   return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function of the graph file with IDENT, NULL if none.
+// --------------------------------------------------------------------------
+static
+function_info* find_function(const object_info* obj, unsigned ident)
+{
+   if (ident < obj->ident_index.size())
+      return obj->ident_index[ident];
+
+   std::unordered_map< unsigned, function_info* >::const_iterator it = obj->ident_map.find(ident);
+   return it != obj->ident_map.end() ? it->second : NULL;
 }
 
 // --------------------------------------------------------------------------
 // Reads profiles from the count file and attach to each
 // function. Return nonzero if fatal error.
 // --------------------------------------------------------------------------
-static int read_count_file(const std::string& gcnaFilename)
+static int read_count_file(object_info* obj, struct gcov_var* reader, const std::string& gcnaFilename)
 {
    unsigned ix;
    unsigned version;
@@ -835,20 +2317,20 @@ static int read_count_file(const std::string& gcnaFilename)
    function_info* fn = NULL;
    int error = 0;
 
-   if (!gcov_open(gcnaFilename.c_str(), 1))
+   if (!gcov_open_r(reader, gcnaFilename.c_str(), 1))
    {
       fnotice(stderr, "%s:cannot open data file\n", gcnaFilename.c_str());
       return 1;
    }
-   if (!gcov_magic(gcov_read_unsigned(), GCOV_DATA_MAGIC))
+   if (!gcov_magic_r(reader, gcov_read_unsigned_r(reader), GCOV_DATA_MAGIC))
    {
       fnotice(stderr, "%s:not a gcov data file\n", gcnaFilename.c_str());
 cleanup:
       ;
-      gcov_close();
+      gcov_close_r(reader);
       return 1;
    }
-   version = gcov_read_unsigned();
+   version = gcov_read_unsigned_r(reader);
    if (version != GCOV_VERSION)
    {
       char v[4], e[4];
@@ -858,45 +2340,30 @@ cleanup:
 
       // fnotice( stderr, "%s:version '%.4s', prefer version '%.4s'\n", gcnaFilename.c_str(), v, e );
    }
-   tag = gcov_read_unsigned();
-   if (tag != gcno_stamp)
+   tag = gcov_read_unsigned_r(reader);
+   if (tag != obj->gcno_stamp)
    {
       fnotice(stderr, "%s:stamp mismatch with graph file\n", gcnaFilename.c_str());
       goto cleanup;
    }
 
-   while ((tag = gcov_read_unsigned()))
+   while ((tag = gcov_read_unsigned_r(reader)))
    {
-      unsigned length = gcov_read_unsigned();
-      unsigned long base = gcov_position();
+      unsigned length = gcov_read_unsigned_r(reader);
+      unsigned long base = gcov_position_r(reader);
 
       if (tag == GCOV_TAG_OBJECT_SUMMARY)
-         gcov_read_summary(&object_summary);
+         gcov_read_summary_r(reader, &obj->object_summary);
       else if (tag == GCOV_TAG_PROGRAM_SUMMARY)
-         program_count++;
+         obj->program_count++;
       else if (tag == GCOV_TAG_FUNCTION)
       {
-         unsigned ident = gcov_read_unsigned();
-         struct function_info* fn_n = functions;
-
-         for (fn = fn ? fn->next : NULL; ; fn = fn->next)
-         {
-            if (fn)
-               ;
-            else if ((fn = fn_n))
-               fn_n = NULL;
-            else
-            {
-               fnotice(stderr, "%s:unknown function '%u'\n", gcnaFilename.c_str(), ident);
-               break;
-            }
-            if (fn->ident == ident)
-               break;
-         }
+         unsigned ident = gcov_read_unsigned_r(reader);
 
+         fn = find_function(obj, ident);
          if (!fn)
-            ;
-         else if (gcov_read_unsigned() != fn->checksum)
+            fnotice(stderr, "%s:unknown function '%u'\n", gcnaFilename.c_str(), ident);
+         else if (gcov_read_unsigned_r(reader) != fn->checksum)
          {
             fnotice(stderr, "%s:profile mismatch for '%s'\n", gcnaFilename.c_str(), fn->name);
             goto cleanup;
@@ -911,63 +2378,83 @@ cleanup:
          }
 
          if (!fn->counts)
-            fn->counts = (gcov_type*)calloc(fn->num_counts, sizeof(gcov_type));
+            fn->counts = obj->arena.Alloc< gcov_type >(fn->num_counts);
 
          for (ix = 0; ix != fn->num_counts; ix++)
-            fn->counts[ix] += gcov_read_counter();
+            fn->counts[ix] += gcov_read_counter_r(reader);
+         fn->executed = any_count(fn->counts, fn->num_counts);
       }
-      gcov_sync(base, length);
-      if ((error = gcov_is_error()))
+      gcov_sync_r(reader, base, length);
+      if ((error = gcov_is_error_r(reader)))
       {
          fnotice(stderr, error < 0 ? "%s:overflowed\n" : "%s:corrupted\n", gcnaFilename.c_str());
          goto cleanup;
       }
    }
 
-   gcov_close();
+   gcov_close_r(reader);
    return 0;
 }
 
+// --------------------------------------------------------------------------
+// true if one of the NUM COUNTS is not zero. Written without early exit so
+// the compiler vectorizes it.
+// --------------------------------------------------------------------------
+static
+bool any_count(const gcov_type* counts, unsigned num)
+{
+   gcov_type any = 0;
+
+   for (unsigned ix = 0; ix != num; ix++)
+      any |= counts[ix];
+   return any != 0;
+}
+
 // --------------------------------------------------------------------------
 // Solve the flow graph. Propagate counts from the instrumented arcs
 // to the blocks and the uninstrumented arcs.
 // --------------------------------------------------------------------------
 static
-void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
+void solve_flow_graph(object_info* obj, function_info* fn, const std::string& gcnoFilename)
 {
    unsigned ix;
    arc_info* arc;
    gcov_type* count_ptr = fn->counts;
+   block_info* blocks = fn->num_blocks ? &obj->blocks[fn->first_block] : NULL;
    block_info* blk;
-   block_info* valid_blocks = NULL;    // valid, but unpropagated blocks.
-   block_info* invalid_blocks = NULL;  // invalid, but inferable blocks.
+   unsigned valid_blocks = NO_INDEX;    // valid, but unpropagated blocks.
+   unsigned invalid_blocks = NO_INDEX;  // invalid, but inferable blocks.
 
    if (fn->num_blocks < 2)
       fnotice(stderr, "%s:'%s' lacks entry and/or exit blocks\n", gcnoFilename.c_str(), fn->name);
    else
    {
-      if (fn->blocks[0].num_pred)
+      if (blocks[0].num_pred)
          fnotice(stderr, "%s:'%s' has arcs to entry block\n", gcnoFilename.c_str(), fn->name);
       else
          // We can't deduce the entry block counts from the lack of predecessors.
-         fn->blocks[0].num_pred = ~(unsigned)0;
+         blocks[0].num_pred = ~(unsigned)0;
 
-      if (fn->blocks[fn->num_blocks - 1].num_succ)
+      if (blocks[fn->num_blocks - 1].num_succ)
          fnotice(stderr, "%s:'%s' has arcs from exit block\n", gcnoFilename.c_str(), fn->name);
       else
          // Likewise, we can't deduce exit block counts from the lack of its successors.
-         fn->blocks[fn->num_blocks - 1].num_succ = ~(unsigned)0;
+         blocks[fn->num_blocks - 1].num_succ = ~(unsigned)0;
    }
 
    // Propagate the measured counts, this must be done in the same order as the code in profile.c
-   for (ix = 0, blk = fn->blocks; ix != fn->num_blocks; ix++, blk++)
+   for (ix = 0, blk = blocks; ix != fn->num_blocks; ix++, blk++)
    {
-      block_info const* prev_dst = NULL;
+      unsigned block = fn->first_block + ix;
+      unsigned* succ = obj->succ_arcs.data() + obj->succ_index[block];
+      unsigned* succ_end = obj->succ_arcs.data() + obj->succ_index[block + 1];
+      unsigned prev_dst = NO_INDEX;
       int out_of_order = 0;
       int non_fake_succ = 0;
 
-      for (arc = blk->succ; arc; arc = arc->succ_next)
+      for (unsigned* it = succ; it != succ_end; ++it)
       {
+         arc = &obj->arcs[*it];
          if (!arc->fake)
             non_fake_succ++;
 
@@ -977,16 +2464,18 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
                arc->count = *count_ptr++;
             arc->count_valid = 1;
             blk->num_succ--;
-            arc->dst->num_pred--;
+            obj->blocks[arc->dst].num_pred--;
          }
-         if (prev_dst && prev_dst > arc->dst)
+         if (prev_dst != NO_INDEX && prev_dst > arc->dst)
             out_of_order = 1;
          prev_dst = arc->dst;
       }
       if (non_fake_succ == 1)
       {
          // If there is only one non-fake exit, it is an unconditional branch.
-         for (arc = blk->succ; arc; arc = arc->succ_next)
+         for (unsigned* it = succ; it != succ_end; ++it)
+         {
+            arc = &obj->arcs[*it];
             if (!arc->fake)
             {
                arc->is_unconditional = 1;
@@ -996,69 +2485,46 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
                // arc has more than one entry.  Mark the destination
                // block as a return site, if none of those conditions
                // hold.
-               if (blk->is_call_site && arc->fall_through && arc->dst->pred == arc && !arc->pred_next)
-                  arc->dst->is_call_return = 1;
+               if (blk->is_call_site && arc->fall_through
+                   && obj->pred_index[arc->dst + 1] - obj->pred_index[arc->dst] == 1)
+                  obj->blocks[arc->dst].is_call_return = 1;
             }
+         }
       }
 
       // Sort the successor arcs into ascending dst order. profile.c
       // normally produces arcs in the right order, but sometimes with
-      // one or two out of order.  We're not using a particularly
-      // smart sort.
+      // one or two out of order. The sort is stable, like the bubble
+      // sort of gcov.
       if (out_of_order)
       {
-         arc_info* start = blk->succ;
-         unsigned changes = 1;
-
-         while (changes)
-         {
-            arc_info* arc, *arc_p, *arc_n;
-
-            changes = 0;
-            for (arc_p = NULL, arc = start; (arc_n = arc->succ_next);)
-            {
-               if (arc->dst > arc_n->dst)
-               {
-                  changes = 1;
-                  if (arc_p)
-                     arc_p->succ_next = arc_n;
-                  else
-                     start = arc_n;
-                  arc->succ_next = arc_n->succ_next;
-                  arc_n->succ_next = arc;
-                  arc_p = arc_n;
-               }
-               else
-               {
-                  arc_p = arc;
-                  arc = arc_n;
-               }
-            }
-         }
-         blk->succ = start;
+         const std::vector< arc_info >& arcs = obj->arcs;
+         std::stable_sort(succ, succ_end, [&arcs](unsigned lhs, unsigned rhs) { return arcs[lhs].dst < arcs[rhs].dst; });
       }
 
       // Place it on the invalid chain, it will be ignored if that's wrong.
       blk->invalid_chain = 1;
       blk->chain = invalid_blocks;
-      invalid_blocks = blk;
+      invalid_blocks = block;
    }
 
-   while (invalid_blocks || valid_blocks)
+   while (invalid_blocks != NO_INDEX || valid_blocks != NO_INDEX)
    {
-      while ((blk = invalid_blocks))
+      unsigned block;
+
+      while ((block = invalid_blocks) != NO_INDEX)
       {
          gcov_type total = 0;
-         const arc_info* arc;
 
+         blk = &obj->blocks[block];
          invalid_blocks = blk->chain;
          blk->invalid_chain = 0;
          if (!blk->num_succ)
-            for (arc = blk->succ; arc; arc = arc->succ_next)
-               total += arc->count;
+            for (ix = obj->succ_index[block]; ix != obj->succ_index[block + 1]; ix++)
+               total += obj->arcs[obj->succ_arcs[ix]].count;
          else if (!blk->num_pred)
-            for (arc = blk->pred; arc; arc = arc->pred_next)
-               total += arc->count;
+            for (ix = obj->pred_index[block]; ix != obj->pred_index[block + 1]; ix++)
+               total += obj->arcs[obj->pred_arcs[ix]].count;
          else
             continue;
 
@@ -1066,13 +2532,14 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
          blk->count_valid = 1;
          blk->chain = valid_blocks;
          blk->valid_chain = 1;
-         valid_blocks = blk;
+         valid_blocks = block;
       }
-      while ((blk = valid_blocks))
+      while ((block = valid_blocks) != NO_INDEX)
       {
          gcov_type total;
-         arc_info* arc, *inv_arc;
+         arc_info* inv_arc;
 
+         blk = &obj->blocks[block];
          valid_blocks = blk->chain;
          blk->valid_chain = 0;
          if (blk->num_succ == 1)
@@ -1081,13 +2548,14 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
 
             total = blk->count;
             inv_arc = NULL;
-            for (arc = blk->succ; arc; arc = arc->succ_next)
+            for (ix = obj->succ_index[block]; ix != obj->succ_index[block + 1]; ix++)
             {
+               arc = &obj->arcs[obj->succ_arcs[ix]];
                total -= arc->count;
                if (!arc->count_valid)
                   inv_arc = arc;
             }
-            dst = inv_arc->dst;
+            dst = &obj->blocks[inv_arc->dst];
             inv_arc->count_valid = 1;
             inv_arc->count = total;
             blk->num_succ--;
@@ -1098,7 +2566,7 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
                {
                   dst->chain = valid_blocks;
                   dst->valid_chain = 1;
-                  valid_blocks = dst;
+                  valid_blocks = inv_arc->dst;
                }
             }
             else
@@ -1107,7 +2575,7 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
                {
                   dst->chain = invalid_blocks;
                   dst->invalid_chain = 1;
-                  invalid_blocks = dst;
+                  invalid_blocks = inv_arc->dst;
                }
             }
          }
@@ -1117,13 +2585,14 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
 
             total = blk->count;
             inv_arc = NULL;
-            for (arc = blk->pred; arc; arc = arc->pred_next)
+            for (ix = obj->pred_index[block]; ix != obj->pred_index[block + 1]; ix++)
             {
+               arc = &obj->arcs[obj->pred_arcs[ix]];
                total -= arc->count;
                if (!arc->count_valid)
                   inv_arc = arc;
             }
-            src = inv_arc->src;
+            src = &obj->blocks[inv_arc->src];
             inv_arc->count_valid = 1;
             inv_arc->count = total;
             blk->num_pred--;
@@ -1134,7 +2603,7 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
                {
                   src->chain = valid_blocks;
                   src->valid_chain = 1;
-                  valid_blocks = src;
+                  valid_blocks = inv_arc->src;
                }
             }
             else
@@ -1143,7 +2612,7 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
                {
                   src->chain = invalid_blocks;
                   src->invalid_chain = 1;
-                  invalid_blocks = src;
+                  invalid_blocks = inv_arc->src;
                }
             }
          }
@@ -1152,7 +2621,7 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
 
    // If the graph has been correctly solved, every block will have a valid count.
    for (ix = 0; ix < fn->num_blocks; ix++)
-      if (!fn->blocks[ix].count_valid)
+      if (!blocks[ix].count_valid)
       {
          fnotice(stderr, "%s:graph is unsolvable for '%s'\n",  gcnoFilename.c_str(), fn->name);
          break;
@@ -1163,18 +2632,18 @@ void solve_flow_graph(function_info* fn, const std::string& gcnoFilename)
 // Increment totals in COVERAGE according to arc ARC.
 // --------------------------------------------------------------------------
 static void
-add_branch_counts(coverage_info* coverage, const arc_info* arc)
+add_branch_counts(const object_info* obj, coverage_info* coverage, const arc_info* arc)
 {
    if (arc->is_call_non_return)
    {
       coverage->calls++;
-      if (arc->src->count)
+      if (obj->blocks[arc->src].count)
          coverage->calls_executed++;
    }
    else if (!arc->is_unconditional)
    {
       coverage->branches++;
-      if (arc->src->count)
+      if (obj->blocks[arc->src].count)
          coverage->branches_executed++;
       if (arc->count)
          coverage->branches_taken++;
@@ -1279,70 +2748,425 @@ std::string make_gcov_file_name(const std::string& src_name)
 // the appropriate basic block.
 // --------------------------------------------------------------------------
 static
-void add_line_counts(function_info* fn, const std::string& gcnoFilename)
+void add_line_counts(object_info* obj, function_info* fn, const std::string& gcnoFilename)
 {
    unsigned ix;
    line_info* line = NULL; // This is propagated from one iteration to the next.
+   bool excluded = false;  // Likewise, the last line is in an excluded source.
+   bool found = false;     // Some line found
 
    // Scan each basic block.
    for (ix = 0; ix != fn->num_blocks; ix++)
    {
-      block_info* block = &fn->blocks[ix];
-      unsigned* encoding;
+      unsigned block_ix = fn->first_block + ix;
+      block_info* block = &obj->blocks[block_ix];
+      const unsigned* encoding = block->u.line.num ? &obj->line_encodings[block->u.line.first] : NULL;
       const source_info* src = NULL;
       unsigned jx;
 
       if (block->count && ix && ix + 1 != fn->num_blocks)
          fn->blocks_executed++;
-      for (jx = 0, encoding = block->u.line.encoding;
-            jx != block->u.line.num; jx++, encoding++)
+      for (jx = 0; jx != block->u.line.num; jx++, encoding++)
          if (!*encoding)
          {
-            unsigned src_n = *++encoding;
-
-            for (src = sources; src->index != src_n; src = src->next)
-               continue;
+            src = obj->source_index[*++encoding];
             jx++;
          }
+         else if (src->excluded)
+         {
+            excluded = true;
+            found = true;
+         }
          else
          {
             line = &src->lines[*encoding];
             line->exists = 1;
             line->count += block->count;
+            excluded = false;
+            found = true;
          }
-      free(block->u.line.encoding);
-      block->u.cycle.arc = NULL;
+      block->u.cycle.arc = NO_INDEX;
       block->u.cycle.ident = ~0U;
 
       if (!ix || ix + 1 == fn->num_blocks)
          ; // Entry or exit block
+      else if (excluded || (!line && fn->src->excluded))
+         ; // Block of an excluded source
       else if (flag_all_blocks)
       {
          line_info* block_line = line ? line : &fn->src->lines[fn->line];
 
          block->chain = block_line->u.blocks;
-         block_line->u.blocks = block;
+         block_line->u.blocks = block_ix;
+         if (!flag_zero_path || fn->executed)
+            block_line->executed = 1;
       }
       else if (flag_branches)
       {
-         arc_info* arc;
+         unsigned jx;
 
-         for (arc = block->succ; arc; arc = arc->succ_next)
+         for (jx = obj->succ_index[block_ix]; jx != obj->succ_index[block_ix + 1]; jx++)
          {
-            arc->line_next = line->u.branches;
-            line->u.branches = arc;
+            unsigned arc_ix = obj->succ_arcs[jx];
+
+            obj->arcs[arc_ix].line_next = line->u.branches;
+            line->u.branches = arc_ix;
          }
       }
    }
-   if (!line)
+   if (!found)
       fnotice(stderr, "%s:no lines for '%s'\n", gcnoFilename.c_str(), fn->name);
 }
 
+// --------------------------------------------------------------------------
+// Count of the cycles of the blocks of line IX, chained from LINE, with the
+// cs_count of their exit arcs initialized: the search of gcov, kept to check
+// line_cycles_count with --check-cycles.
+// --------------------------------------------------------------------------
+static
+gcov_type line_cycles_count_tiernan(object_info* obj, const line_info* line, unsigned ix)
+{
+   gcov_type count = 0;
+   unsigned block;
+
+   // Find the loops. This uses the algorithm described in
+   // Tiernan 'An Efficient Search Algorithm to Find the
+   // Elementary Circuits of a Graph', CACM Dec 1970. We hold
+   // the P array by having each block hold the successor
+   // position of the arc that connects to the previous block.
+   // The H array is implicitly held because of the arc
+   // ordering, and the block's previous arc position.
+
+   // Although the algorithm is O(N^3) for highly connected
+   // graphs, at worst we'll have O(N^2), as most blocks have
+   // only one or two exits. Most graphs will be small.
+
+   // For each loop we find, locate the arc with the smallest
+   // transition count, and add that to the cumulative
+   // count.  Decrease flow over the cycle and remove the arc
+   // from consideration.
+   for (block = line->u.blocks; block != NO_INDEX; block = obj->blocks[block].chain)
+   {
+      unsigned head = block;
+      unsigned pos;    // position of the current arc in succ_arcs
+
+next_vertex:
+      ;
+      pos = obj->succ_index[head];
+current_vertex:
+      ;
+      while (pos != obj->succ_index[head + 1])
+      {
+         arc_info* arc = &obj->arcs[obj->succ_arcs[pos]];
+         unsigned dst = arc->dst;
+         if (// Already used that arc.
+            arc->cycle
+            // Not to same graph, or before first vertex.
+            || obj->blocks[dst].u.cycle.ident != ix
+            // Already in path.
+            || obj->blocks[dst].u.cycle.arc != NO_INDEX)
+         {
+            pos++;
+            continue;
+         }
+
+         if (dst == block)
+         {
+            // Found a closing arc.
+            gcov_type cycle_count = arc->cs_count;
+            arc_info* cycle_arc = arc;
+            unsigned probe;
+
+            // Locate the smallest arc count of the loop.
+            for (dst = head; (probe = obj->blocks[dst].u.cycle.arc) != NO_INDEX;
+                  dst = obj->arcs[obj->succ_arcs[probe]].src)
+            {
+               arc_info* probe_arc = &obj->arcs[obj->succ_arcs[probe]];
+
+               if (cycle_count > probe_arc->cs_count)
+               {
+                  cycle_count = probe_arc->cs_count;
+                  cycle_arc = probe_arc;
+               }
+            }
+
+            count += cycle_count;
+            cycle_arc->cycle = 1;
+
+            // Remove the flow from the cycle.
+            arc->cs_count -= cycle_count;
+            for (dst = head; (probe = obj->blocks[dst].u.cycle.arc) != NO_INDEX;
+                  dst = obj->arcs[obj->succ_arcs[probe]].src)
+               obj->arcs[obj->succ_arcs[probe]].cs_count -= cycle_count;
+
+            // Unwind to the cyclic arc.
+            while (head != cycle_arc->src)
+            {
+               pos = obj->blocks[head].u.cycle.arc;
+               obj->blocks[head].u.cycle.arc = NO_INDEX;
+               head = obj->arcs[obj->succ_arcs[pos]].src;
+            }
+            // Move on.
+            pos++;
+            continue;
+         }
+
+         // Add new block to chain.
+         obj->blocks[dst].u.cycle.arc = pos;
+         head = dst;
+         goto next_vertex;
+      }
+      // We could not add another vertex to the path. Remove
+      // the last vertex from the list.
+      pos = obj->blocks[head].u.cycle.arc;
+      if (pos != NO_INDEX)
+      {
+         // It was not the first vertex. Move onto next arc.
+         obj->blocks[head].u.cycle.arc = NO_INDEX;
+         head = obj->arcs[obj->succ_arcs[pos]].src;
+         pos++;
+         goto current_vertex;
+      }
+      // Mark this block as unusable.
+      obj->blocks[block].u.cycle.ident = ~0U;
+   }
+   return count;
+}
+
+// --------------------------------------------------------------------------
+// Count of the cycles of the blocks of line IX, chained from LINE, with the
+// cs_count of their exit arcs initialized.
+//
+// For each loop found, locate the arc with the smallest transition count,
+// and add that to the cumulative count. Decrease flow over the cycle and
+// remove the arc from consideration. The loops are found in the order of
+// the search of gcov, Tiernan 'An Efficient Search Algorithm to Find the
+// Elementary Circuits of a Graph', CACM Dec 1970, so the counts are the
+// same, but the search is pruned as in Johnson 'Finding All the Elementary
+// Circuits of a Directed Graph', SIAM J. Comput. 1975: a block left without
+// finding a loop is blocked until a block it leads to is left after a loop
+// is found. As each loop found removes an arc, this is
+// O((blocks + arcs) * arcs) for a line, where Tiernan is exponential.
+//
+// The path is held by having each block hold the successor position of the
+// arc that connects to the previous block.
+// --------------------------------------------------------------------------
+static
+gcov_type line_cycles_count(object_info* obj, const line_info* line, unsigned ix, unsigned long long& iterations)
+{
+   std::vector< unsigned char >& state = obj->cycle_state;
+   std::vector< unsigned >& blocked_by = obj->cycle_blocked_by;
+   std::vector< std::pair< unsigned, unsigned > >& pool = obj->cycle_pool;
+   std::vector< unsigned >& touched = obj->cycle_touched;
+   std::vector< unsigned >& unblocking = obj->cycle_unblocking;
+   gcov_type count = 0;
+
+   if (state.size() < obj->blocks.size())
+   {
+      state.resize(obj->blocks.size(), 0);
+      blocked_by.resize(obj->blocks.size(), NO_INDEX);
+   }
+
+   // The blocks touched by a search are reset, before the next one and on
+   // return: the next line may be of an object with fewer blocks
+   auto reset = [&]()
+   {
+      for (size_t jx = 0; jx < touched.size(); ++jx)
+      {
+         state[touched[jx]] = 0;
+         blocked_by[touched[jx]] = NO_INDEX;
+      }
+      touched.clear();
+      pool.clear();
+   };
+
+   // Block B and the ones blocked by it are unblocked
+   auto unblock = [&](unsigned b)
+   {
+      unblocking.push_back(b);
+      while (!unblocking.empty())
+      {
+         unsigned current = unblocking.back();
+         unblocking.pop_back();
+         state[current] &= ~CYCLE_BLOCKED;
+         for (unsigned entry = blocked_by[current]; entry != NO_INDEX; entry = pool[entry].second)
+            if (state[pool[entry].first] & CYCLE_BLOCKED)
+               unblocking.push_back(pool[entry].first);
+         blocked_by[current] = NO_INDEX;
+      }
+   };
+
+   for (unsigned block = line->u.blocks; block != NO_INDEX; block = obj->blocks[block].chain)
+   {
+      unsigned head = block;
+      unsigned pos;    // position of the current arc in succ_arcs
+
+      // Blocking starts again from each first vertex
+      reset();
+      state[block] = CYCLE_BLOCKED;
+      touched.push_back(block);
+
+      pos = obj->succ_index[head];
+      for (;;)
+      {
+         if (pos != obj->succ_index[head + 1])
+         {
+            arc_info* arc = &obj->arcs[obj->succ_arcs[pos]];
+            unsigned dst = arc->dst;
+
+            iterations++;
+            if (// Already used that arc.
+               arc->cycle
+               // Not to same graph, or before first vertex.
+               || obj->blocks[dst].u.cycle.ident != ix
+               // Already in path.
+               || obj->blocks[dst].u.cycle.arc != NO_INDEX
+               // Leads to no loop.
+               || (dst != block && (state[dst] & CYCLE_BLOCKED)))
+            {
+               pos++;
+               continue;
+            }
+
+            if (dst == block)
+            {
+               // Found a closing arc.
+               gcov_type cycle_count = arc->cs_count;
+               arc_info* cycle_arc = arc;
+               unsigned probe;
+
+               // Locate the smallest arc count of the loop, the blocks of
+               // the path lead to a loop.
+               for (dst = head; (probe = obj->blocks[dst].u.cycle.arc) != NO_INDEX;
+                     dst = obj->arcs[obj->succ_arcs[probe]].src)
+               {
+                  arc_info* probe_arc = &obj->arcs[obj->succ_arcs[probe]];
+
+                  state[dst] |= CYCLE_FOUND;
+                  if (cycle_count > probe_arc->cs_count)
+                  {
+                     cycle_count = probe_arc->cs_count;
+                     cycle_arc = probe_arc;
+                  }
+               }
+
+               count += cycle_count;
+               cycle_arc->cycle = 1;
+
+               // Remove the flow from the cycle.
+               arc->cs_count -= cycle_count;
+               for (dst = head; (probe = obj->blocks[dst].u.cycle.arc) != NO_INDEX;
+                     dst = obj->arcs[obj->succ_arcs[probe]].src)
+                  obj->arcs[obj->succ_arcs[probe]].cs_count -= cycle_count;
+
+               // Unwind to the cyclic arc.
+               while (head != cycle_arc->src)
+               {
+                  pos = obj->blocks[head].u.cycle.arc;
+                  obj->blocks[head].u.cycle.arc = NO_INDEX;
+                  state[head] &= ~CYCLE_FOUND;
+                  unblock(head);
+                  head = obj->arcs[obj->succ_arcs[pos]].src;
+               }
+               // Move on.
+               pos++;
+               continue;
+            }
+
+            // Add new block to chain.
+            obj->blocks[dst].u.cycle.arc = pos;
+            state[dst] = CYCLE_BLOCKED;
+            touched.push_back(dst);
+            head = dst;
+            pos = obj->succ_index[head];
+            continue;
+         }
+
+         // We could not add another vertex to the path. Remove the last
+         // vertex from the list.
+         pos = obj->blocks[head].u.cycle.arc;
+         if (pos == NO_INDEX)
+            break;
+
+         // It leads to a loop, or is blocked until one of the blocks it
+         // leads to is unblocked.
+         if (state[head] & CYCLE_FOUND)
+         {
+            state[head] &= ~CYCLE_FOUND;
+            unblock(head);
+         }
+         else
+            for (unsigned jx = obj->succ_index[head]; jx != obj->succ_index[head + 1]; jx++)
+            {
+               const arc_info* arc = &obj->arcs[obj->succ_arcs[jx]];
+               if (!arc->cycle && obj->blocks[arc->dst].u.cycle.ident == ix)
+               {
+                  pool.push_back(std::make_pair(head, blocked_by[arc->dst]));
+                  blocked_by[arc->dst] = (unsigned)pool.size() - 1;
+                  touched.push_back(arc->dst);
+               }
+            }
+
+         // It was not the first vertex. Move onto next arc.
+         obj->blocks[head].u.cycle.arc = NO_INDEX;
+         head = obj->arcs[obj->succ_arcs[pos]].src;
+         pos++;
+      }
+      // Mark this block as unusable.
+      obj->blocks[block].u.cycle.ident = ~0U;
+   }
+   reset();
+
+   return count;
+}
+
+// --------------------------------------------------------------------------
+// line_cycles_count, checked against line_cycles_count_tiernan: a
+// different count for the line LINE_NUM of SRC is reported, and the one of
+// Tiernan returned.
+// --------------------------------------------------------------------------
+static
+gcov_type check_line_cycles_count(object_info* obj, const source_info* src, const line_info* line, unsigned ix, unsigned long long& iterations)
+{
+   gcov_type count = line_cycles_count(obj, line, ix, iterations);
+   unsigned line_num = (unsigned)(line - src->lines);
+
+   // The search leaves no block blocked, for the next lines, which may be
+   // of an object with fewer blocks
+   if (!obj->cycle_touched.empty() || !obj->cycle_pool.empty())
+   {
+      stats.cycle_mismatches++;
+      fnotice(stderr, "%s:%u:cycle search not reset\n", SourceNames.Name(src->id).c_str(), line_num);
+   }
+
+   // Back to the state before the search
+   for (unsigned block = line->u.blocks; block != NO_INDEX; block = obj->blocks[block].chain)
+   {
+      obj->blocks[block].u.cycle.ident = ix;
+      obj->blocks[block].u.cycle.arc = NO_INDEX;
+      for (unsigned jx = obj->succ_index[block]; jx != obj->succ_index[block + 1]; jx++)
+      {
+         arc_info* arc = &obj->arcs[obj->succ_arcs[jx]];
+         arc->cycle = 0;
+         arc->cs_count = arc->count;
+      }
+   }
+
+   gcov_type expected = line_cycles_count_tiernan(obj, line, ix);
+   stats.cycle_checks++;
+   if (count != expected)
+   {
+      stats.cycle_mismatches++;
+      fnotice(stderr, "%s:%u:cycle count %lld, expected %lld\n", SourceNames.Name(src->id).c_str(), line_num, (long long)count, (long long)expected);
+   }
+   return expected;
+}
+
 // --------------------------------------------------------------------------
 // Accumulate the line counts of a file.
 // --------------------------------------------------------------------------
 static
-void accumulate_line_counts(source_info* src)
+void accumulate_line_counts(object_info* obj, source_info* src)
 {
    line_info* line;
    function_info* fn, *fn_p, *fn_n;
@@ -1361,20 +3185,35 @@ void accumulate_line_counts(source_info* src)
    {
       if (!flag_all_blocks)
       {
-         arc_info* arc, *arc_p, *arc_n;
+         unsigned arc, arc_p, arc_n;
 
          // Total and reverse the branch information.
-         for (arc = line->u.branches, arc_p = NULL; arc;
+         for (arc = line->u.branches, arc_p = NO_INDEX; arc != NO_INDEX;
                arc_p = arc, arc = arc_n)
          {
-            arc_n = arc->line_next;
-            arc->line_next = arc_p;
+            arc_n = obj->arcs[arc].line_next;
+            obj->arcs[arc].line_next = arc_p;
 
-            add_branch_counts(&src->coverage, arc);
+            add_branch_counts(obj, &src->coverage, &obj->arcs[arc]);
          }
          line->u.branches = arc_p;
       }
-      else if (line->u.blocks)
+      else if (line->u.blocks != NO_INDEX && !line->executed)
+      {
+         // Only blocks of functions with no count: reverse them for the
+         // branch order, the count is zero.
+         unsigned block, block_p, block_n;
+
+         for (block = line->u.blocks, block_p = NO_INDEX; block != NO_INDEX;
+               block_p = block, block = block_n)
+         {
+            block_n = obj->blocks[block].chain;
+            obj->blocks[block].chain = block_p;
+         }
+         line->u.blocks = block_p;
+         line->count = 0;
+      }
+      else if (line->u.blocks != NO_INDEX)
       {
          // The user expects the line count to be the number of times
          // a line has been executed. Simply summing the block count
@@ -1382,134 +3221,53 @@ void accumulate_line_counts(source_info* src)
          // is to sum the entry counts to the graph of blocks on this
          // line, then find the elementary cycles of the local graph
          // and add the transition counts of those cycles.
-         block_info* block, *block_p, *block_n;
+         unsigned block, block_p, block_n;
          gcov_type count = 0;
 
          // Reverse the block information.
-         for (block = line->u.blocks, block_p = NULL; block;
+         for (block = line->u.blocks, block_p = NO_INDEX; block != NO_INDEX;
                block_p = block, block = block_n)
          {
-            block_n = block->chain;
-            block->chain = block_p;
-            block->u.cycle.ident = ix;
+            block_n = obj->blocks[block].chain;
+            obj->blocks[block].chain = block_p;
+            obj->blocks[block].u.cycle.ident = ix;
          }
          line->u.blocks = block_p;
 
          // Sum the entry arcs.
-         for (block = line->u.blocks; block; block = block->chain)
+         for (block = line->u.blocks; block != NO_INDEX; block = obj->blocks[block].chain)
          {
-            arc_info* arc;
+            unsigned jx;
 
-            for (arc = block->pred; arc; arc = arc->pred_next)
+            for (jx = obj->pred_index[block]; jx != obj->pred_index[block + 1]; jx++)
             {
-               if (arc->src->u.cycle.ident != ix)
+               arc_info* arc = &obj->arcs[obj->pred_arcs[jx]];
+
+               if (obj->blocks[arc->src].u.cycle.ident != ix)
                   count += arc->count;
                if (flag_branches)
-                  add_branch_counts(&src->coverage, arc);
+                  add_branch_counts(obj, &src->coverage, arc);
             }
 
             // Initialize the cs_count.
-            for (arc = block->succ; arc; arc = arc->succ_next)
-               arc->cs_count = arc->count;
-         }
-
-         // Find the loops. This uses the algorithm described in
-         // Tiernan 'An Efficient Search Algorithm to Find the
-         // Elementary Circuits of a Graph', CACM Dec 1970. We hold
-         // the P array by having each block point to the arc that
-         // connects to the previous block. The H array is implicitly
-         // held because of the arc ordering, and the block's
-         // previous arc pointer.
-
-         // Although the algorithm is O(N^3) for highly connected
-         // graphs, at worst we'll have O(N^2), as most blocks have
-         // only one or two exits. Most graphs will be small.
-
-         // For each loop we find, locate the arc with the smallest
-         // transition count, and add that to the cumulative
-         // count.  Decrease flow over the cycle and remove the arc
-         // from consideration.
-         for (block = line->u.blocks; block; block = block->chain)
-         {
-            block_info* head = block;
-            arc_info* arc;
-
-next_vertex:
-            ;
-            arc = head->succ;
-current_vertex:
-            ;
-            while (arc)
+            for (jx = obj->succ_index[block]; jx != obj->succ_index[block + 1]; jx++)
             {
-               block_info* dst = arc->dst;
-               if (// Already used that arc.
-                  arc->cycle
-                  // Not to same graph, or before first vertex.
-                  || dst->u.cycle.ident != ix
-                  // Already in path.
-                  || dst->u.cycle.arc)
-               {
-                  arc = arc->succ_next;
-                  continue;
-               }
-
-               if (dst == block)
-               {
-                  // Found a closing arc.
-                  gcov_type cycle_count = arc->cs_count;
-                  arc_info* cycle_arc = arc;
-                  arc_info* probe_arc;
-
-                  // Locate the smallest arc count of the loop.
-                  for (dst = head; (probe_arc = dst->u.cycle.arc);
-                        dst = probe_arc->src)
-                     if (cycle_count > probe_arc->cs_count)
-                     {
-                        cycle_count = probe_arc->cs_count;
-                        cycle_arc = probe_arc;
-                     }
-
-                  count += cycle_count;
-                  cycle_arc->cycle = 1;
-
-                  // Remove the flow from the cycle.
-                  arc->cs_count -= cycle_count;
-                  for (dst = head; (probe_arc = dst->u.cycle.arc);
-                        dst = probe_arc->src)
-                     probe_arc->cs_count -= cycle_count;
-
-                  // Unwind to the cyclic arc.
-                  while (head != cycle_arc->src)
-                  {
-                     arc = head->u.cycle.arc;
-                     head->u.cycle.arc = NULL;
-                     head = arc->src;
-                  }
-                  // Move on.
-                  arc = arc->succ_next;
-                  continue;
-               }
+               arc_info* arc = &obj->arcs[obj->succ_arcs[jx]];
 
-               // Add new block to chain.
-               dst->u.cycle.arc = arc;
-               head = dst;
-               goto next_vertex;
-            }
-            // We could not add another vertex to the path. Remove
-            // the last vertex from the list.
-            arc = head->u.cycle.arc;
-            if (arc)
-            {
-               // It was not the first vertex. Move onto next arc.
-               head->u.cycle.arc = NULL;
-               head = arc->src;
-               arc = arc->succ_next;
-               goto current_vertex;
+               arc->cs_count = arc->count;
             }
-            // Mark this block as unusable.
-            block->u.cycle.ident = ~0U;
          }
 
+         // Find the loops, and add their transition counts.
+         unsigned long long iterations = 0;
+         if (flag_check_cycles)
+            count += check_line_cycles_count(obj, src, line, ix, iterations);
+         else
+            count += line_cycles_count(obj, line, ix, iterations);
+         stats.add_cycle_iterations(iterations);
+         if (flag_log_cycles && iterations >= flag_log_cycles)
+            fnotice(stderr, "%s:%u:%llu cycle search iterations\n", SourceNames.Name(src->id).c_str(), (unsigned)(line - src->lines), iterations);
+
          line->count = count;
       }
 
@@ -1527,7 +3285,7 @@ current_vertex:
 // anything is output.
 // --------------------------------------------------------------------------
 static
-int output_branch_count(int ix, const arc_info* arc, int& branch, gcov_type& taken)
+int output_branch_count(const object_info* obj, int ix, const arc_info* arc, int& branch, gcov_type& taken)
 {
    if (arc->is_call_non_return)
    {
@@ -1541,9 +3299,9 @@ int output_branch_count(int ix, const arc_info* arc, int& branch, gcov_type& tak
    else if (!arc->is_unconditional)
    {
       branch = ix;
-      taken = (arc->src->count ? arc->count : -1);
+      taken = (obj->blocks[arc->src].count ? arc->count : -1);
    }
-   else if (flag_unconditional && !arc->dst->is_call_return)
+   else if (flag_unconditional && !obj->blocks[arc->dst].is_call_return)
    {
       //if (arc->src->count)
       //  fnotice (gcov_file, "unconditional %2d taken %s\n", ix, format_gcov (arc->count, arc->src->count, -flag_counts));
@@ -1559,11 +3317,16 @@ int output_branch_count(int ix, const arc_info* arc, int& branch, gcov_type& tak
 // Aggregate the info on the global information
 // --------------------------------------------------------------------------
 static
-void aggregate_info(const source_info* src)
+void aggregate_info(const object_info* obj, const source_info* src, SourceInfos& infos)
 {
-   Functions& srcFunctions = SourceFunctions[ src->name ];
-   Lines& srcLines = SourceLines[ src->name ];
-   Branches& srcBranches = SourceBranches[ src->name ];
+   infos.sources.push_back(std::make_pair(src->id, SourceCoverage()));
+   SourceCoverage& coverage = infos.sources.back().second;
+   coverage.found = true;
+
+   Functions& srcFunctions = coverage.functions;
+   Lines& srcLines = coverage.lines;
+   Branches& srcBranches = coverage.branches;
+   srcLines.assign(src->num_lines, NO_LINE);
 
    unsigned line_num;         // current line number.
    const line_info* line;     // current line info ptr.
@@ -1575,16 +3338,16 @@ void aggregate_info(const source_info* src)
    {
       for (; fn && fn->line == line_num; fn = fn->line_next)
       {
-         arc_info* arc = fn->blocks[fn->num_blocks - 1].pred;
-         gcov_type return_count = fn->blocks[fn->num_blocks - 1].count;
+         unsigned exit_block = fn->first_block + fn->num_blocks - 1;
+         gcov_type return_count = obj->blocks[exit_block].count;
 
-         for (; arc; arc = arc->pred_next)
-            if (arc->fake)
-               return_count -= arc->count;
+         for (unsigned jx = obj->pred_index[exit_block]; jx != obj->pred_index[exit_block + 1]; jx++)
+            if (obj->arcs[obj->pred_arcs[jx]].fake)
+               return_count -= obj->arcs[obj->pred_arcs[jx]].count;
 
-         std::string functionName = Demangled(fn->name);
-         srcFunctions[ functionName ].line = fn->line;
-         srcFunctions[ functionName ].hit += fn->blocks[0].count;
+         FunctionInfo& function = srcFunctions[ FunctionNames.Intern(fn->name) ];
+         function.line = fn->line;
+         function.hit += obj->blocks[fn->first_block].count;
       }
 
       // For lines which don't exist in the .bb file, print '-' before
@@ -1594,42 +3357,41 @@ void aggregate_info(const source_info* src)
       // 16 spaces of indentation added before the source line so that
       // tabs won't be messed up.
       if (line->exists)
-         srcLines[ line_num ] += line->count;
+         srcLines[ line_num ] = line->count;
 
       // Looking for all blocks
-      block_info* block;
+      unsigned block;
 
       BranchId currentBranchId;
 
       int ix, jx;
-      for (ix = jx = 0, block = line->u.blocks; block; block = block->chain)
+      for (ix = jx = 0, block = line->u.blocks; block != NO_INDEX; block = obj->blocks[block].chain)
       {
          currentBranchId.line = line_num;
          currentBranchId.block = 9999;
 
-         if (!block->is_call_return)
+         if (!obj->blocks[block].is_call_return)
             currentBranchId.block = ix++;
 
-         for (arc_info* arc = block->succ; arc; arc = arc->succ_next)
+         for (unsigned kx = obj->succ_index[block]; kx != obj->succ_index[block + 1]; kx++)
          {
+            const arc_info* arc = &obj->arcs[obj->succ_arcs[kx]];
+
             currentBranchId.branch = -1;
             gcov_type taken = -1;
-            jx += output_branch_count(jx, arc, currentBranchId.branch, taken);
+            jx += output_branch_count(obj, jx, arc, currentBranchId.branch, taken);
 
             if (currentBranchId.branch != -1)
             {
-               gcov_type currentTaken = -1;
-               if (srcBranches.find(currentBranchId) != srcBranches.end())
-                  currentTaken = srcBranches[ currentBranchId ];
-
-               if (taken >= 0)
-               {
-                  if (currentTaken < 0) currentTaken = taken;
-                  else currentTaken += taken;
-               }
-               srcBranches[ currentBranchId ] = currentTaken;
+               srcBranches.push_back(BranchInfo());
+               srcBranches.back().id = currentBranchId;
+               srcBranches.back().taken = taken;
             }
          }
       }
    }
+
+   // The call return blocks of a line all have the block number 9999, so
+   // the branches are only sorted by line.
+   SortBranches(srcBranches);
 }
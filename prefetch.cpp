@@ -0,0 +1,82 @@
+#include "prefetch.h"
+
+#include <chrono>
+
+#include <stdio.h>
+#include <fcntl.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+// ---------------------------------------------------------------------------
+Prefetcher::Prefetcher(unsigned count) : files(0), time(0), stopping(false)
+{
+   for (unsigned ix = 0; ix < (count ? count : 1); ++ix)
+      threads.push_back(std::thread([this]() { Work(); }));
+}
+
+// ---------------------------------------------------------------------------
+Prefetcher::~Prefetcher()
+{
+   {
+      std::lock_guard< std::mutex > lock(mutex);
+      stopping = true;
+      added.notify_all();
+   }
+   for (size_t ix = 0; ix < threads.size(); ++ix)
+      threads[ix].join();
+}
+
+// ---------------------------------------------------------------------------
+void Prefetcher::Add(const std::string& filename)
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   queue.push_back(filename);
+   added.notify_one();
+}
+
+// ---------------------------------------------------------------------------
+void Prefetcher::Work()
+{
+   for (;;)
+   {
+      std::string filename;
+      {
+         std::unique_lock< std::mutex > lock(mutex);
+         added.wait(lock, [this]() { return stopping || !queue.empty(); });
+         if (queue.empty())
+            return;
+         filename.swap(queue.front());
+         queue.pop_front();
+      }
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#ifdef WIN32
+      // No read-ahead hint: the file is read once into the cache
+      FILE* file = fopen(filename.c_str(), "rb");
+      if (file)
+      {
+         char buffer[ 64 * 1024 ];
+         while (fread(buffer, 1, sizeof(buffer), file) == sizeof(buffer))
+            ;
+         fclose(file);
+      }
+#else
+      int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd >= 0)
+      {
+#ifdef POSIX_FADV_WILLNEED
+         posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+         close(fd);
+      }
+#endif
+      ++files;
+
+      double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+      double current = time.load();
+      while (!time.compare_exchange_weak(current, current + seconds))
+         ;
+   }
+}
@@ -0,0 +1,47 @@
+#ifndef __PREFETCH_H_INCLUDED__
+#define __PREFETCH_H_INCLUDED__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Read-ahead of the files about to be read, so their I/O overlaps with the
+// work on the current ones. Each file added is opened by one of a few I/O
+// threads and its content requested into the page cache
+// (posix_fadvise(WILLNEED)), without waiting for it. The caller bounds how
+// far ahead it adds files.
+class Prefetcher
+{
+public:
+   // THREADS I/O threads, at least one
+   explicit Prefetcher(unsigned threads);
+   // Stops after the files added
+   ~Prefetcher();
+
+   // Queue FILENAME for read-ahead
+   void Add(const std::string& filename);
+
+   // Counters, for --stats
+   std::atomic< unsigned > files; // # of files read ahead
+   std::atomic< double > time;    // spent by the I/O threads
+   unsigned Threads() const { return (unsigned)threads.size(); }
+
+private:
+   Prefetcher(const Prefetcher&);
+   Prefetcher& operator = (const Prefetcher&);
+
+   void Work();
+
+   std::mutex mutex;
+   std::condition_variable added;
+   std::deque< std::string > queue;
+   bool stopping;
+   std::vector< std::thread > threads;
+};
+
+#endif
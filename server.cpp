@@ -0,0 +1,362 @@
+#include "server.h"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef SOCK_CLOEXEC
+#define SOCK_CLOEXEC 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+#ifdef WIN32
+// ---------------------------------------------------------------------------
+int Serve(const std::string&, const std::function< int(const std::vector< std::string >&) >&)
+{
+   std::cerr << "--serve is not supported on this system" << std::endl;
+   return 1;
+}
+
+// ---------------------------------------------------------------------------
+int Connect(const std::string&, const std::vector< std::string >&)
+{
+   std::cerr << "--connect is not supported on this system" << std::endl;
+   return 1;
+}
+#else
+
+// ---------------------------------------------------------------------------
+// A request: the header, sent with the descriptors of the client's standard
+// input, output, error and current directory, then the arguments, each NUL
+// terminated. The reply is the exit status, once the request is done.
+const uint32_t REQUEST_MAGIC = 0x76727363; // "csrv"
+const int REQUEST_DESCRIPTORS = 4;
+
+struct RequestHeader
+{
+   uint32_t magic;
+   uint32_t size; // of the arguments
+};
+
+// Set by SIGINT and SIGTERM
+static volatile sig_atomic_t stopping = 0;
+
+// ---------------------------------------------------------------------------
+static
+void Stop(int)
+{
+   stopping = 1;
+}
+
+// ---------------------------------------------------------------------------
+// Address of the socket PATH, false if too long
+static
+bool Address(const std::string& path, sockaddr_un& address)
+{
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   if (path.size() >= sizeof(address.sun_path))
+   {
+      std::cerr << "socket path too long: " << path << std::endl;
+      return false;
+   }
+   memcpy(address.sun_path, path.c_str(), path.size() + 1);
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+static
+bool ReadAll(int fd, void* data, size_t size)
+{
+   char* position = static_cast< char* >(data);
+   while (size)
+   {
+      ssize_t count = read(fd, position, size);
+      if (count < 0 && errno == EINTR)
+         continue;
+      if (count <= 0)
+         return false;
+      position += count;
+      size -= count;
+   }
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+static
+bool WriteAll(int fd, const void* data, size_t size)
+{
+   const char* position = static_cast< const char* >(data);
+   while (size)
+   {
+      ssize_t count = write(fd, position, size);
+      if (count < 0 && errno == EINTR)
+         continue;
+      if (count <= 0)
+         return false;
+      position += count;
+      size -= count;
+   }
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+// Receive a request on CONNECTION: its ARGUMENTS and the descriptors of the
+// client in FDS. false if it is not a valid request.
+static
+bool Receive(int connection, std::vector< std::string >& arguments, int fds[ REQUEST_DESCRIPTORS ])
+{
+   RequestHeader header;
+   iovec data = { &header, sizeof(header) };
+   union
+   {
+      cmsghdr align;
+      char buffer[ CMSG_SPACE(sizeof(int) * REQUEST_DESCRIPTORS) ];
+   } control;
+   msghdr message;
+   memset(&message, 0, sizeof(message));
+   message.msg_iov = &data;
+   message.msg_iovlen = 1;
+   message.msg_control = control.buffer;
+   message.msg_controllen = sizeof(control.buffer);
+
+   ssize_t count;
+   while ((count = recvmsg(connection, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+      ;
+   if (count <= 0)
+      return false;
+
+   int received = 0;
+   for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg))
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      {
+         int number = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+         for (int ix = 0; ix < number; ++ix)
+         {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + ix * sizeof(int), sizeof(int));
+            if (received < REQUEST_DESCRIPTORS)
+               fds[received++] = fd;
+            else
+               close(fd);
+         }
+      }
+
+   bool ok = received == REQUEST_DESCRIPTORS
+             && (count == sizeof(header) || ReadAll(connection, reinterpret_cast< char* >(&header) + count, sizeof(header) - count))
+             && header.magic == REQUEST_MAGIC && header.size < (1U << 24);
+   std::string text(ok ? header.size : 0, '\0');
+   ok = ok && ReadAll(connection, &text[0], text.size()) && (text.empty() || text.back() == '\0');
+   if (!ok)
+   {
+      for (int ix = 0; ix < received; ++ix)
+         close(fds[ix]);
+      return false;
+   }
+
+   for (size_t position = 0; position < text.size(); position = text.find('\0', position) + 1)
+      arguments.push_back(text.c_str() + position);
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+int Serve(const std::string& path, const std::function< int(const std::vector< std::string >&) >& handler)
+{
+   sockaddr_un address;
+   if (!Address(path, address))
+      return 1;
+
+   // A socket left by a server which is gone is replaced
+   int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   bool running = probe >= 0 && !connect(probe, reinterpret_cast< sockaddr* >(&address), sizeof(address));
+   if (probe >= 0)
+      close(probe);
+   if (running)
+   {
+      std::cerr << "a server already runs on " << path << std::endl;
+      return 1;
+   }
+   unlink(path.c_str());
+
+   int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (listener < 0)
+   {
+      std::cerr << "socket error [" << errno << "]" << std::endl;
+      return 1;
+   }
+
+   // Only the user may connect: the requests run with the server's rights
+   mode_t mask = umask(077);
+   bool bound = !bind(listener, reinterpret_cast< sockaddr* >(&address), sizeof(address));
+   umask(mask);
+   if (!bound || listen(listener, 16))
+   {
+      std::cerr << "cannot listen on " << path << " [" << errno << "]" << std::endl;
+      close(listener);
+      return 1;
+   }
+
+   struct sigaction action;
+   memset(&action, 0, sizeof(action));
+   action.sa_handler = Stop;
+   action.sa_flags = SA_RESTART;
+   sigaction(SIGINT, &action, 0);
+   sigaction(SIGTERM, &action, 0);
+   // A client gone during its request must not stop the server
+   signal(SIGPIPE, SIG_IGN);
+
+   // The server's own descriptors, restored after each request
+   int saved[ REQUEST_DESCRIPTORS ] = { dup(0), dup(1), dup(2), open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+   FILE* log = fdopen(dup(2), "w");
+   setvbuf(log, NULL, _IOLBF, 0);
+   fprintf(log, "Serving on %s\n", path.c_str());
+
+   while (!stopping)
+   {
+      pollfd waiting = { listener, POLLIN, 0 };
+      if (poll(&waiting, 1, -1) <= 0)
+         continue;
+      int connection = accept(listener, 0, 0);
+      if (connection < 0)
+         continue;
+
+      std::vector< std::string > arguments;
+      int fds[ REQUEST_DESCRIPTORS ];
+      if (!Receive(connection, arguments, fds))
+      {
+         fprintf(log, "invalid request\n");
+         close(connection);
+         continue;
+      }
+
+      std::string line;
+      for (size_t ix = 0; ix < arguments.size(); ++ix)
+         line += " " + arguments[ix];
+      fprintf(log, "Request :%s\n", line.c_str());
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      // Run as the client
+      std::cout.flush();
+      fflush(stdout);
+      fflush(stderr);
+      for (int ix = 0; ix < 3; ++ix)
+         dup2(fds[ix], ix);
+      // A request which fails with an exception fails alone
+      int32_t status = 1;
+      try
+      {
+         if (!fchdir(fds[3]))
+            status = handler(arguments);
+      }
+      catch (const std::exception& exception)
+      {
+         std::cerr << "request failed: " << exception.what() << std::endl;
+         fprintf(log, "request failed: %s\n", exception.what());
+      }
+      catch (...)
+      {
+         std::cerr << "request failed" << std::endl;
+         fprintf(log, "request failed\n");
+      }
+
+      std::cout.flush();
+      std::cerr.flush();
+      fflush(stdout);
+      fflush(stderr);
+      for (int ix = 0; ix < 3; ++ix)
+         dup2(saved[ix], ix);
+      if (fchdir(saved[3]))
+         fprintf(log, "cannot return to the directory of the server\n");
+      std::cin.clear();
+      clearerr(stdin);
+      for (int ix = 0; ix < REQUEST_DESCRIPTORS; ++ix)
+         close(fds[ix]);
+
+      fprintf(log, "Done    : status %d, %.3f s\n", (int)status,
+              std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count());
+      WriteAll(connection, &status, sizeof(status));
+      close(connection);
+   }
+
+   fprintf(log, "Stopped\n");
+   fclose(log);
+   close(listener);
+   unlink(path.c_str());
+   for (int ix = 0; ix < REQUEST_DESCRIPTORS; ++ix)
+      close(saved[ix]);
+   return 0;
+}
+
+// ---------------------------------------------------------------------------
+int Connect(const std::string& path, const std::vector< std::string >& arguments)
+{
+   sockaddr_un address;
+   if (!Address(path, address))
+      return 1;
+
+   int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (connection < 0 || connect(connection, reinterpret_cast< sockaddr* >(&address), sizeof(address)))
+   {
+      std::cerr << "cannot connect to the server on " << path << " [" << errno << "]" << std::endl;
+      if (connection >= 0)
+         close(connection);
+      return 1;
+   }
+
+   std::string text;
+   for (size_t ix = 0; ix < arguments.size(); ++ix)
+      text.append(arguments[ix].c_str(), arguments[ix].size() + 1);
+
+   RequestHeader header = { REQUEST_MAGIC, (uint32_t)text.size() };
+   iovec data = { &header, sizeof(header) };
+   int fds[ REQUEST_DESCRIPTORS ] = { 0, 1, 2, open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+   union
+   {
+      cmsghdr align;
+      char buffer[ CMSG_SPACE(sizeof(fds)) ];
+   } control;
+   memset(&control, 0, sizeof(control));
+   msghdr message;
+   memset(&message, 0, sizeof(message));
+   message.msg_iov = &data;
+   message.msg_iovlen = 1;
+   message.msg_control = control.buffer;
+   message.msg_controllen = sizeof(control.buffer);
+   cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+   memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+   int32_t status = 1;
+   bool ok = fds[3] >= 0 && sendmsg(connection, &message, 0) == (ssize_t)sizeof(header)
+             && WriteAll(connection, text.data(), text.size())
+             && ReadAll(connection, &status, sizeof(status));
+   if (!ok)
+   {
+      std::cerr << "the server on " << path << " did not answer" << std::endl;
+      status = 1;
+   }
+   if (fds[3] >= 0)
+      close(fds[3]);
+   close(connection);
+   return status;
+}
+#endif
@@ -0,0 +1,26 @@
+#ifndef __SERVER_H_INCLUDED__
+#define __SERVER_H_INCLUDED__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Capture server on a local (Unix domain) socket, so the caches of a long
+// running process serve the captures of an edit-test loop. A request is the
+// command line of a run, without the program name. The client also passes
+// its standard input, output and error and its current directory: the
+// request runs as if the client had run it itself, and the client exits
+// with its status. Requests are run one at a time, in the order received.
+
+// Run the requests received on the socket PATH with HANDLER, which gets
+// the arguments and returns the exit status; a request for which HANDLER
+// throws fails with status 1, the next ones are served. Returns when interrupted
+// (SIGINT or SIGTERM), or on error with a nonzero status.
+int Serve(const std::string& path, const std::function< int(const std::vector< std::string >&) >& handler);
+
+// Send the request ARGUMENTS to the server on the socket PATH, and wait for
+// it. Returns the status of the request, 1 if the server can't be reached.
+int Connect(const std::string& path, const std::vector< std::string >& arguments);
+
+#endif
@@ -0,0 +1,143 @@
+#include "sourcetable.h"
+#include "filter.h"
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------------
+SourceTable::SourceTable()
+   : excludedSize(0), filter(0)
+{
+}
+
+// ---------------------------------------------------------------------------
+void SourceTable::SetFilter(const SourceFilter* sourceFilter)
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   filter = sourceFilter && !sourceFilter->Empty() ? sourceFilter : 0;
+
+   // The sources interned by a previous run of a server
+   excludedSize = 0;
+   for (size_t id = 0; id < names.size(); ++id)
+   {
+      excluded[id] = filter && filter->Excluded(names[id]);
+      excludedSize += excluded[id];
+   }
+}
+
+// ---------------------------------------------------------------------------
+SourceId SourceTable::Intern(const std::string& directory, const char* name)
+{
+   // The key buffer of each thread keeps its capacity from one call to the next
+   static thread_local std::string key;
+   key.clear();
+   if (name[0] != '/')
+      key += directory;
+   key += '\0';
+   key += name;
+
+   std::lock_guard< std::mutex > lock(mutex);
+
+   std::unordered_map< std::string, SourceId >::const_iterator found = raw.find(key);
+   if (found != raw.end())
+      return found->second;
+
+   std::string path = Normalize(name[0] != '/' ? directory + name : std::string(name));
+   std::pair< std::unordered_map< std::string, SourceId >::iterator, bool > inserted =
+      normalized.insert(std::make_pair(path, (SourceId)names.size()));
+   if (inserted.second)
+   {
+      names.push_back(path);
+      bool filtered = filter && filter->Excluded(path);
+      excluded.push_back(filtered);
+      excludedSize += filtered;
+   }
+
+   raw.insert(std::make_pair(key, inserted.first->second));
+   return inserted.first->second;
+}
+
+// ---------------------------------------------------------------------------
+const std::string& SourceTable::Name(SourceId id) const
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   return names[ id ];
+}
+
+// ---------------------------------------------------------------------------
+bool SourceTable::Excluded(SourceId id) const
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   return excluded[ id ];
+}
+
+// ---------------------------------------------------------------------------
+size_t SourceTable::ExcludedSize() const
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   return excludedSize;
+}
+
+// ---------------------------------------------------------------------------
+size_t SourceTable::Size() const
+{
+   std::lock_guard< std::mutex > lock(mutex);
+   return names.size();
+}
+
+// ---------------------------------------------------------------------------
+std::vector< SourceId > SourceTable::SortedIds() const
+{
+   std::lock_guard< std::mutex > lock(mutex);
+
+   std::vector< SourceId > ids(names.size());
+   for (size_t ix = 0; ix < ids.size(); ++ix)
+      ids[ix] = ix;
+   std::sort(ids.begin(), ids.end(), [this](SourceId lhs, SourceId rhs) { return names[lhs] < names[rhs]; });
+   return ids;
+}
+
+// ---------------------------------------------------------------------------
+std::string SourceTable::Normalize(const std::string& path)
+{
+   bool absolute = !path.empty() && path[0] == '/';
+
+   // Components kept so far, as [begin, end) ranges of path
+   std::vector< std::pair< size_t, size_t > > components;
+   size_t begin = 0;
+   while (begin <= path.size())
+   {
+      size_t end = path.find('/', begin);
+      if (end == std::string::npos)
+         end = path.size();
+
+      size_t length = end - begin;
+      if (length == 0 || (length == 1 && path[begin] == '.'))
+         ; // duplicated slash or "."
+      else if (length == 2 && path[begin] == '.' && path[begin + 1] == '.')
+      {
+         if (!components.empty()
+             && !(components.back().second - components.back().first == 2 && path.compare(components.back().first, 2, "..") == 0))
+            components.pop_back();
+         else if (!absolute)
+            components.push_back(std::make_pair(begin, end)); // above a relative root, kept
+         // else "/.." is "/"
+      }
+      else
+         components.push_back(std::make_pair(begin, end));
+      begin = end + 1;
+   }
+
+   std::string result;
+   result.reserve(path.size());
+   if (absolute)
+      result += '/';
+   for (size_t ix = 0; ix < components.size(); ++ix)
+   {
+      if (ix)
+         result += '/';
+      result.append(path, components[ix].first, components[ix].second - components[ix].first);
+   }
+   if (result.empty())
+      result = ".";
+   return result;
+}
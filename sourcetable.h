@@ -0,0 +1,62 @@
+#ifndef __SOURCETABLE_H_INCLUDED__
+#define __SOURCETABLE_H_INCLUDED__
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Identity of a normalized source path
+typedef unsigned SourceId;
+
+class SourceFilter;
+
+// ---------------------------------------------------------------------------
+// Process-wide table of the source files. The names found in the graph
+// files are interned once per (gcno directory, name) and normalized, so the
+// same file reached through different relative paths gets one id. Safe to
+// use from several capture workers.
+class SourceTable
+{
+public:
+   SourceTable();
+
+   // Filter applied to each new source, none by default. The sources
+   // already interned are filtered again, e.g. for the next run of a
+   // server. Not to be called during a capture.
+   void SetFilter(const SourceFilter* filter);
+
+   // Id of the source NAME, relative to DIRECTORY unless absolute.
+   // DIRECTORY is empty or ends with a '/'.
+   SourceId Intern(const std::string& directory, const char* name);
+
+   // Normalized path of ID, valid for the life of the table.
+   const std::string& Name(SourceId id) const;
+
+   // true if ID is filtered out, decided once when it is interned
+   bool Excluded(SourceId id) const;
+
+   // # of sources
+   size_t Size() const;
+
+   // # of sources filtered out
+   size_t ExcludedSize() const;
+
+   // All the ids, in ascending order of their names
+   std::vector< SourceId > SortedIds() const;
+
+   // PATH without "." components, duplicated slashes and "dir/.." pairs.
+   static std::string Normalize(const std::string& path);
+
+private:
+   mutable std::mutex mutex;
+   std::unordered_map< std::string, SourceId > raw;        // "directory\0name" -> id
+   std::unordered_map< std::string, SourceId > normalized; // normalized path -> id
+   std::deque< std::string > names;                        // normalized path by id
+   std::deque< char > excluded;                            // filtered out, by id
+   size_t excludedSize;
+   const SourceFilter* filter;
+};
+
+#endif
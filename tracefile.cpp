@@ -0,0 +1,228 @@
+#include "tracefile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <charconv>
+#include <unordered_map>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#endif
+
+// ---------------------------------------------------------------------------
+MappedFile::MappedFile()
+   : data(0), size(0), map(0)
+{
+}
+
+// ---------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+#ifndef WIN32
+   if (map)
+      munmap(map, size);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+bool MappedFile::Open(const std::string& filename)
+{
+#ifndef WIN32
+   int fd = open(filename.c_str(), O_RDONLY);
+   if (fd < 0)
+      return false;
+
+   struct stat status;
+   if (fstat(fd, &status) != 0)
+   {
+      close(fd);
+      return false;
+   }
+   size = status.st_size;
+   if (size)
+   {
+      map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED)
+         map = 0;
+   }
+   close(fd);
+   if (!size)
+      return true;
+   if (!map)
+      return false;
+   madvise(map, size, MADV_SEQUENTIAL);
+   data = (const char*)map;
+
+   if (size < 2 || data[0] != '\x1f' || data[1] != '\x8b')
+      return true;
+
+   // gzip: inflate the whole file in memory
+   munmap(map, size);
+   map = 0;
+   data = 0;
+   size = 0;
+
+   gzFile file = gzopen(filename.c_str(), "rb");
+   if (!file)
+      return false;
+   gzbuffer(file, 256 * 1024);
+   char chunk[ 64 * 1024 ];
+   int length;
+   while ((length = gzread(file, chunk, sizeof(chunk))) > 0)
+      buffer.append(chunk, length);
+   bool ok = length == 0;
+   gzclose(file);
+#else
+   FILE* file = fopen(filename.c_str(), "rb");
+   if (!file)
+      return false;
+   char chunk[ 64 * 1024 ];
+   size_t length;
+   while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+      buffer.append(chunk, length);
+   bool ok = !ferror(file);
+   fclose(file);
+#endif
+   data = buffer.data();
+   size = buffer.size();
+   return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Parse the number at TEXT, up to END. TEXT is moved after it and its
+// separator (a ',').
+template< class T >
+static
+bool ParseNumber(const char*& text, const char* end, T& value)
+{
+   std::from_chars_result result = std::from_chars(text, end, value);
+   if (result.ec != std::errc())
+      return false;
+   text = result.ptr;
+   if (text != end && *text == ',')
+      ++text;
+   return true;
+}
+
+// ---------------------------------------------------------------------------
+static
+bool StartsWith(const char* text, const char* end, const char* prefix, size_t length)
+{
+   return (size_t)(end - text) >= length && !memcmp(text, prefix, length);
+}
+
+// ---------------------------------------------------------------------------
+bool ParseTracefile(const char* data, size_t size, SourceInfos& infos, std::string& error)
+{
+   // Index of each source in INFOS, and ids of the function names
+   std::unordered_map< SourceId, size_t > sources;
+   std::unordered_map< std::string, SymbolId > symbols;
+   std::string name;
+
+   SourceCoverage* current = 0;
+   bool skipping = false; // in the record of an excluded source
+   const char* end = data + size;
+   unsigned lineNumber = 0;
+   for (const char* line = data; line < end; )
+   {
+      const char* next = (const char*)memchr(line, '\n', end - line);
+      const char* eol = next ? next : end;
+      next = next ? next + 1 : end;
+      ++lineNumber;
+      if (eol != line && eol[-1] == '\r')
+         --eol;
+
+      const char* text = line;
+      bool ok = true;
+      if (skipping && !StartsWith(line, eol, "SF:", 3) && !StartsWith(line, eol, "end_of_record", 13))
+         ; // Filtered out
+      else if (StartsWith(line, eol, "DA:", 3))
+      {
+         text += 3;
+         long long number = 0, count = 0;
+         ok = current && ParseNumber(text, eol, number) && ParseNumber(text, eol, count) && number >= 0
+              && number <= MAX_LINE_NUMBER;
+         if (ok)
+         {
+            Lines& lines = current->lines;
+            if ((size_t)number >= lines.size())
+               lines.resize(number + 1, NO_LINE);
+            if (lines[number] == NO_LINE) lines[number] = count;
+            else lines[number] += count;
+         }
+      }
+      else if (StartsWith(line, eol, "BRDA:", 5))
+      {
+         text += 5;
+         BranchInfo branch;
+         ok = current && ParseNumber(text, eol, branch.id.line) && ParseNumber(text, eol, branch.id.block)
+              && ParseNumber(text, eol, branch.id.branch);
+         if (ok && text != eol && *text == '-')
+            branch.taken = -1;
+         else
+            ok = ok && ParseNumber(text, eol, branch.taken);
+         if (ok)
+            current->branches.push_back(branch);
+      }
+      else if (StartsWith(line, eol, "FN:", 3) || StartsWith(line, eol, "FNDA:", 5))
+      {
+         bool hits = line[2] == 'D';
+         text += hits ? 5 : 3;
+         long long number = 0;
+         ok = current && ParseNumber(text, eol, number);
+         if (ok)
+         {
+            name.assign(text, eol - text);
+            std::unordered_map< std::string, SymbolId >::const_iterator found = symbols.find(name);
+            SymbolId id = found != symbols.end() ? found->second : (symbols[name] = FunctionNames.InternName(name));
+
+            FunctionInfo& function = current->functions[ id ];
+            if (hits)
+               function.hit += number;
+            else
+               function.line = number;
+         }
+      }
+      else if (StartsWith(line, eol, "SF:", 3))
+      {
+         name.assign(line + 3, eol - line - 3);
+         SourceId id = SourceNames.Intern(std::string(), name.c_str());
+         skipping = SourceNames.Excluded(id);
+         if (skipping)
+         {
+            current = 0;
+            line = next;
+            continue;
+         }
+         std::pair< std::unordered_map< SourceId, size_t >::iterator, bool > inserted = sources.insert(std::make_pair(id, infos.sources.size()));
+         if (inserted.second)
+            infos.sources.push_back(std::make_pair(id, SourceCoverage()));
+         current = &infos.sources[ inserted.first->second ].second;
+         current->found = true;
+      }
+      else if (StartsWith(line, eol, "end_of_record", 13))
+      {
+         current = 0;
+         skipping = false;
+      }
+      // else TN, FNF, FNH, BRF, BRH, LF, LH..., computed again when written
+
+      if (!ok)
+      {
+         char where[ 32 ];
+         snprintf(where, sizeof(where), "%u", lineNumber);
+         error = std::string("malformed line ") + where + ": " + std::string(line, eol - line);
+         return false;
+      }
+      line = next;
+   }
+
+   for (size_t ix = 0; ix < infos.sources.size(); ++ix)
+      SortBranches(infos.sources[ix].second.branches);
+   return true;
+}
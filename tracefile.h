@@ -0,0 +1,40 @@
+#ifndef __TRACEFILE_H_INCLUDED__
+#define __TRACEFILE_H_INCLUDED__
+
+#include "coverage.h"
+
+#include <stddef.h>
+#include <string>
+
+// ---------------------------------------------------------------------------
+// Content of a file, mapped in memory when possible. A gzip file is inflated
+// in memory.
+class MappedFile
+{
+public:
+   MappedFile();
+   ~MappedFile();
+
+   // Map or read FILENAME, false on error
+   bool Open(const std::string& filename);
+
+   const char* Data() const { return data; }
+   size_t Size() const { return size; }
+
+private:
+   MappedFile(const MappedFile&);
+   MappedFile& operator = (const MappedFile&);
+
+   const char* data;
+   size_t size;
+   void* map;          // mapping, if any
+   std::string buffer; // content read or inflated, if not mapped
+};
+
+// ---------------------------------------------------------------------------
+// Parse the lcov tracefile DATA of SIZE bytes into INFOS, with the same
+// rules as a capture: the records of a source given twice are merged.
+// Returns false on a malformed line, described in ERROR.
+bool ParseTracefile(const char* data, size_t size, SourceInfos& infos, std::string& error);
+
+#endif
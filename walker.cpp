@@ -0,0 +1,352 @@
+#include "walker.h"
+
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifndef WIN32
+// Identity of a file or directory, through the links
+typedef std::pair< dev_t, ino_t > FileIdentity;
+#endif
+
+// ---------------------------------------------------------------------------
+// A directory to read, DEPTH levels below the walked one. When following
+// the links, ANCESTORS are the directories above it, to stop the loops.
+struct WalkTask
+{
+   std::string path;
+   int depth;
+#ifndef WIN32
+   std::vector< FileIdentity > ancestors;
+#endif
+};
+
+// ---------------------------------------------------------------------------
+// Tasks queued by one worker. The worker takes the last one, the deepest,
+// and the thieves the first one, the largest subtree.
+struct WalkQueue
+{
+   std::mutex mutex;
+   std::deque< WalkTask > tasks;
+};
+
+// ---------------------------------------------------------------------------
+// State of one Walk, shared by its workers
+struct WalkState
+{
+#ifdef WIN32
+   explicit WalkState(unsigned jobs) : queues(jobs), files(jobs), pending(0), queued(0) {}
+#else
+   explicit WalkState(unsigned jobs) : queues(jobs), files(jobs), pending(0), queued(0), linked(jobs) {}
+#endif
+
+   // Queue TASK for the worker SELF
+   void Push(unsigned self, WalkTask&& task);
+
+   // Next task of the worker SELF, its own or stolen from another worker.
+   // false if all the queues are empty.
+   bool Pop(unsigned self, WalkTask& task);
+
+   std::vector< WalkQueue > queues;                  // by worker
+   std::vector< std::vector< std::string > > files; // found, by worker
+   std::atomic< size_t > pending;                   // # of tasks queued or being read
+   std::atomic< size_t > queued;                    // # of tasks queued
+
+   std::mutex mutex;             // for wake, and the error messages
+   std::condition_variable wake; // a task is queued, or all are done
+
+#ifndef WIN32
+   // Files found when following the links, by worker, with their identity
+   std::vector< std::vector< std::pair< FileIdentity, std::string > > > linked;
+#endif
+};
+
+// ---------------------------------------------------------------------------
+void WalkState::Push(unsigned self, WalkTask&& task)
+{
+   ++pending;
+   {
+      std::lock_guard< std::mutex > lock(queues[self].mutex);
+      queues[self].tasks.push_back(std::move(task));
+   }
+   ++queued;
+
+   std::lock_guard< std::mutex > lock(mutex);
+   wake.notify_one();
+}
+
+// ---------------------------------------------------------------------------
+bool WalkState::Pop(unsigned self, WalkTask& task)
+{
+   for (size_t ix = 0; ix < queues.size(); ++ix)
+   {
+      WalkQueue& queue = queues[(self + ix) % queues.size()];
+      std::lock_guard< std::mutex > lock(queue.mutex);
+      if (queue.tasks.empty())
+         continue;
+
+      if (!ix)
+      {
+         task = std::move(queue.tasks.back());
+         queue.tasks.pop_back();
+      }
+      else
+      {
+         task = std::move(queue.tasks.front());
+         queue.tasks.pop_front();
+      }
+      --queued;
+      return true;
+   }
+   return false;
+}
+
+#if defined(__linux__)
+// ---------------------------------------------------------------------------
+// Record of getdents64
+struct linux_dirent64
+{
+   uint64_t d_ino;
+   int64_t d_off;
+   unsigned short d_reclen;
+   unsigned char d_type;
+   char d_name[1];
+};
+#endif
+
+// ---------------------------------------------------------------------------
+DirectoryWalker::DirectoryWalker(const char* suffix, unsigned jobs, bool follow, int maxDepth)
+   : directories(0), entries(0), suffix(suffix), jobs(jobs ? jobs : 1), follow(follow), maxDepth(maxDepth)
+{
+}
+
+// ---------------------------------------------------------------------------
+std::vector< std::string > DirectoryWalker::Walk(const std::string& directory)
+{
+   WalkState state(jobs);
+   WalkTask root = { directory, 0 };
+   state.Push(0, std::move(root));
+
+   std::vector< std::thread > workers;
+   for (unsigned job = 1; job < jobs; ++job)
+      workers.push_back(std::thread([this, &state, job]() { Work(state, job); }));
+   Work(state, 0);
+   for (size_t ix = 0; ix < workers.size(); ++ix)
+      workers[ix].join();
+
+   std::vector< std::string > files;
+   files.swap(state.files[0]);
+   for (size_t ix = 1; ix < state.files.size(); ++ix)
+      files.insert(files.end(), std::make_move_iterator(state.files[ix].begin()), std::make_move_iterator(state.files[ix].end()));
+
+#ifndef WIN32
+   // A file reached through several links is taken once, at its smallest
+   // path, whatever the order in which the workers reached it
+   if (follow)
+   {
+      std::vector< std::pair< FileIdentity, std::string > > linked;
+      for (size_t ix = 0; ix < state.linked.size(); ++ix)
+         linked.insert(linked.end(), std::make_move_iterator(state.linked[ix].begin()), std::make_move_iterator(state.linked[ix].end()));
+      std::sort(linked.begin(), linked.end());
+      for (size_t ix = 0; ix < linked.size(); ++ix)
+         if (!ix || linked[ix].first != linked[ix - 1].first)
+         {
+            files.push_back(std::move(linked[ix].second));
+            if (found)
+               found(files.back());
+         }
+   }
+#endif
+   return files;
+}
+
+// ---------------------------------------------------------------------------
+void DirectoryWalker::Work(WalkState& state, unsigned self)
+{
+   for (;;)
+   {
+      WalkTask task;
+      if (state.Pop(self, task))
+      {
+         Read(state, self, task);
+         if (!--state.pending)
+         {
+            std::lock_guard< std::mutex > lock(state.mutex);
+            state.wake.notify_all();
+         }
+         continue;
+      }
+
+      std::unique_lock< std::mutex > lock(state.mutex);
+      state.wake.wait(lock, [&]() { return !state.pending || state.queued; });
+      if (!state.pending)
+         break;
+   }
+}
+
+// ---------------------------------------------------------------------------
+void DirectoryWalker::Add(WalkState& state, unsigned self, const WalkTask& task, std::string& path, size_t base, const char* name, bool directory)
+{
+   if (directory)
+   {
+      if (name[0] == '.' || (maxDepth >= 0 && task.depth >= maxDepth))
+         return;
+      path.resize(base);
+      path += name;
+      WalkTask child = { path, task.depth + 1 };
+#ifndef WIN32
+      child.ancestors = task.ancestors;
+#endif
+      state.Push(self, std::move(child));
+      return;
+   }
+
+   size_t length = strlen(name);
+   if (length <= suffix.size() || memcmp(name + length - suffix.size(), suffix.data(), suffix.size()))
+      return;
+   path.resize(base);
+   path += name;
+#ifndef WIN32
+   // Identified, to be deduplicated once all are found
+   struct stat status;
+   if (follow && !stat(path.c_str(), &status))
+   {
+      state.linked[self].push_back(std::make_pair(FileIdentity(status.st_dev, status.st_ino), path));
+      return;
+   }
+#endif
+   state.files[self].push_back(path);
+   if (found)
+      found(path);
+}
+
+// ---------------------------------------------------------------------------
+// Read the directory of TASK, queuing its subdirectories
+void DirectoryWalker::Read(WalkState& state, unsigned self, WalkTask& task)
+{
+   std::string path = task.path + "/";
+   const size_t base = path.size();
+   unsigned long long count = 0;
+
+#ifdef WIN32
+   WIN32_FIND_DATAA file;
+   HANDLE search = FindFirstFileA((path + "*").c_str(), &file);
+   if (search == INVALID_HANDLE_VALUE)
+   {
+      std::lock_guard< std::mutex > lock(state.mutex);
+      std::cerr << "opendir error [" << GetLastError() << "] on [" << task.path << "]" << std::endl;
+      return;
+   }
+   do
+   {
+      const char* name = file.cFileName;
+      if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+         continue;
+      ++count;
+      Add(state, self, task, path, base, name, (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+   }
+   while (FindNextFileA(search, &file));
+   FindClose(search);
+#else
+   int fd = open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      std::lock_guard< std::mutex > lock(state.mutex);
+      std::cerr << "opendir error [" << errno << "] on [" << task.path << "]" << std::endl;
+      return;
+   }
+
+   // Through the links, a directory may be reached several times: it is
+   // read each time, but not below itself
+   struct stat status;
+   if (follow && !fstat(fd, &status))
+   {
+      const FileIdentity identity(status.st_dev, status.st_ino);
+      if (std::find(task.ancestors.begin(), task.ancestors.end(), identity) != task.ancestors.end())
+      {
+         close(fd);
+         return;
+      }
+      task.ancestors.push_back(identity);
+   }
+
+   // Type of the entry NAME, from the file system if unknown or a link to follow
+   auto isDirectory = [&](const char* name, unsigned char type)
+   {
+      if (type == DT_UNKNOWN || (type == DT_LNK && follow))
+      {
+         struct stat status;
+         if (!fstatat(fd, name, &status, follow ? 0 : AT_SYMLINK_NOFOLLOW))
+            return S_ISDIR(status.st_mode);
+      }
+      return type == DT_DIR;
+   };
+
+#if defined(__linux__)
+   // Batches of entries, 64 KB at a time
+   alignas(8) char buffer[ 64 * 1024 ];
+   long size;
+   while ((size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0)
+   {
+      for (long position = 0; position < size; )
+      {
+         const linux_dirent64* entry = reinterpret_cast< const linux_dirent64* >(buffer + position);
+         position += entry->d_reclen;
+
+         const char* name = entry->d_name;
+         if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+         ++count;
+         Add(state, self, task, path, base, name, isDirectory(name, entry->d_type));
+      }
+   }
+   if (size < 0)
+   {
+      std::lock_guard< std::mutex > lock(state.mutex);
+      std::cerr << "readdir error [" << errno << "] on [" << task.path << "]" << std::endl;
+   }
+   close(fd);
+#else
+   DIR* rep = fdopendir(fd);
+   if (!rep)
+   {
+      close(fd);
+      return;
+   }
+   dirent* entry;
+   while ((entry = readdir(rep)))
+   {
+      const char* name = entry->d_name;
+      if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+         continue;
+      ++count;
+      Add(state, self, task, path, base, name, isDirectory(name, entry->d_type));
+   }
+   closedir(rep);
+#endif
+#endif
+
+   ++directories;
+   entries += count;
+}
@@ -0,0 +1,50 @@
+#ifndef __WALKER_H_INCLUDED__
+#define __WALKER_H_INCLUDED__
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Parallel search of the files by suffix in a directory tree. Each directory
+// is a task, queued by the worker which found it and stolen by the idle
+// ones. The entries are read by batches (getdents64 on Linux) and only the
+// names ending with the suffix are kept, in per-worker vectors. Directories
+// whose name starts with a '.' are skipped.
+class DirectoryWalker
+{
+public:
+   // Files ending with SUFFIX, searched by JOBS threads. Symbolic links to
+   // directories are followed if FOLLOW, except to a directory above: a
+   // file reached through several links is then found once, at its
+   // smallest path, and only once all are found. The directories deeper
+   // than MAX_DEPTH below the walked one are not read, -1 for no limit.
+   DirectoryWalker(const char* suffix, unsigned jobs, bool follow, int maxDepth);
+
+   // Called for each file found, from the walking threads (at the end of
+   // Walk when following the links), if set
+   std::function< void(const std::string&) > found;
+
+   // Files found under DIRECTORY, as DIRECTORY/.../name, in no order
+   std::vector< std::string > Walk(const std::string& directory);
+
+   // Counters, for --stats
+   std::atomic< unsigned long long > directories; // # of directories read
+   std::atomic< unsigned long long > entries;     // # of entries read
+
+private:
+   DirectoryWalker(const DirectoryWalker&);
+   DirectoryWalker& operator = (const DirectoryWalker&);
+
+   void Work(struct WalkState& state, unsigned self);
+   void Read(WalkState& state, unsigned self, struct WalkTask& task);
+   void Add(WalkState& state, unsigned self, const WalkTask& task, std::string& path, size_t base, const char* name, bool directory);
+
+   std::string suffix;
+   unsigned jobs;
+   bool follow;
+   int maxDepth;
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include "writer.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// The Windows project does not link zlib, no gzip output there
+#ifndef WIN32
+#define WRITER_ZLIB 1
+#include <zlib.h>
+#else
+#define WRITER_ZLIB 0
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// # of sources formatted together by one thread
+static const size_t BATCH_SIZE = 64;
+
+// Size of the blocks written
+static const size_t WRITE_SIZE = 1024 * 1024;
+
+// ---------------------------------------------------------------------------
+static
+void Append(std::string& out, const char* text)
+{
+   out.append(text, strlen(text));
+}
+
+// ---------------------------------------------------------------------------
+static
+void Append(std::string& out, long long number)
+{
+   char buffer[ 24 ];
+   std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+   out.append(buffer, result.ptr - buffer);
+}
+
+#if WRITER_ZLIB
+// ---------------------------------------------------------------------------
+// Compress IN as a raw deflate chunk appended to OUT. The chunks end on a
+// byte boundary (a sync flush) and only the LAST one is final, so they can
+// be compressed independently and concatenated into one deflate stream,
+// as pigz does.
+static
+bool Deflate(const std::string& in, bool last, std::string& out)
+{
+   z_stream stream;
+   memset(&stream, 0, sizeof(stream));
+   if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+
+   size_t start = out.size();
+   out.resize(start + deflateBound(&stream, in.size()) + 16);
+   stream.next_in = (Bytef*)in.data();
+   stream.avail_in = in.size();
+   stream.next_out = (Bytef*)&out[start];
+   stream.avail_out = out.size() - start;
+
+   int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+   int status;
+   while ((status = deflate(&stream, flush)) == Z_OK && (last || stream.avail_out == 0))
+   {
+      // The bound was too small, go on with a larger buffer
+      size_t used = out.size() - stream.avail_out;
+      out.resize(out.size() * 2);
+      stream.next_out = (Bytef*)&out[used];
+      stream.avail_out = out.size() - used;
+   }
+   out.resize(out.size() - stream.avail_out);
+   deflateEnd(&stream);
+   return status == (last ? Z_STREAM_END : Z_OK) || (!last && status == Z_BUF_ERROR);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+void FormatRecord(std::string& out, SourceId id, const SourceCoverage& coverage)
+{
+   const Functions& functions = coverage.functions;
+
+   // Header section
+   Append(out, "TN:\nSF:");
+   out += SourceNames.Name(id);
+   out += '\n';
+
+   // Functions in the order of their demangled names
+   typedef std::pair< const std::string*, const FunctionInfo* > NamedFunction;
+   std::vector< NamedFunction > named;
+   named.reserve(functions.size());
+   for (Functions::const_iterator function = functions.begin(); function != functions.end(); ++function)
+      named.push_back(NamedFunction(&FunctionNames.Name(function->first), &function->second));
+   std::sort(named.begin(), named.end(), [](const NamedFunction& lhs, const NamedFunction& rhs) { return *lhs.first < *rhs.first; });
+
+   // FN section
+   long long fnf = functions.size(); // function count
+   long long fnh = 0; // function hit
+   for (std::vector< NamedFunction >::const_iterator function = named.begin(); function != named.end(); ++function)
+   {
+      Append(out, "FN:");
+      Append(out, function->second->line);
+      out += ',';
+      out += *function->first;
+      out += '\n';
+   }
+
+   // FNDA section
+   for (std::vector< NamedFunction >::const_iterator function = named.begin(); function != named.end(); ++function)
+   {
+      if (function->second->hit) ++fnh;
+      Append(out, "FNDA:");
+      Append(out, function->second->hit);
+      out += ',';
+      out += *function->first;
+      out += '\n';
+   }
+   Append(out, "FNF:");
+   Append(out, fnf);
+   Append(out, "\nFNH:");
+   Append(out, fnh);
+   out += '\n';
+
+   // BRDA section
+   const Branches& branches = coverage.branches;
+   long long brf = branches.size(); // # of branches found
+   long long brh = 0; // # of branches hit
+   for (Branches::const_iterator it = branches.begin(); it != branches.end(); ++it)
+   {
+      if (it->taken) ++brh;
+
+      Append(out, "BRDA:");
+      Append(out, it->id.line);
+      out += ',';
+      Append(out, it->id.block);
+      out += ',';
+      Append(out, it->id.branch);
+      out += ',';
+      if (it->taken < 0) out += '-';
+      else Append(out, it->taken);
+      out += '\n';
+   }
+   Append(out, "BRF:");
+   Append(out, brf);
+   Append(out, "\nBRH:");
+   Append(out, brh);
+   out += '\n';
+
+   // DA section
+   const Lines& lines = coverage.lines;
+   long long lf = 0; // # of instrumented lines
+   long long lh = 0; // # of lines with non zero execution count
+   for (size_t line = 0; line < lines.size(); ++line)
+   {
+      if (lines[line] == NO_LINE) continue;
+
+      ++lf;
+      if (lines[line] > 0) ++lh;
+
+      Append(out, "DA:");
+      Append(out, (long long)line);
+      out += ',';
+      Append(out, lines[line]);
+      out += '\n';
+   }
+   Append(out, "LF:");
+   Append(out, lf);
+   Append(out, "\nLH:");
+   Append(out, lh);
+
+   // Closing
+   Append(out, "\nend_of_record\n");
+}
+
+// ---------------------------------------------------------------------------
+bool WriteTracefile(const std::string& filename, unsigned jobs, bool compress, unsigned& sources)
+{
+#if !WRITER_ZLIB
+   if (compress)
+      return false;
+#endif
+
+   // Sources in the order of their names
+   std::vector< SourceId > ids = SourceNames.SortedIds();
+   ids.erase(std::remove_if(ids.begin(), ids.end(), [](SourceId id) { return id >= Coverage.size() || !Coverage[id].found; }), ids.end());
+   sources = ids.size();
+
+   FILE* file = stdout;
+   if (filename == "-")
+   {
+      fflush(stdout);
+#ifdef WIN32
+      _setmode(_fileno(stdout), _O_BINARY);
+#endif
+   }
+   else if (!(file = fopen(filename.c_str(), "wb")))
+      return false;
+   // The blocks are large, no need to copy them in a stdio buffer: each
+   // one is a single write, also when it goes to a pipe.
+   setvbuf(file, NULL, _IONBF, 0);
+
+   // At least one batch, for the end of the gzip stream
+   const size_t count = std::max< size_t >(1, (ids.size() + BATCH_SIZE - 1) / BATCH_SIZE);
+   if (jobs < 1)
+      jobs = 1;
+   if (jobs > count)
+      jobs = count;
+   const size_t window = 4 * jobs;
+
+   struct batch
+   {
+      batch() : crc(0), size(0), ok(true), done(false) {}
+      std::string text;   // formatted records, or their compression
+      unsigned long crc;  // CRC-32 of the records, if compressed
+      size_t size;        // # of bytes of the records
+      bool ok;
+      bool done;
+   };
+   std::vector< batch > batches(count);
+   std::mutex mutex;
+   std::condition_variable formatted; // a batch is done
+   std::condition_variable written;   // a batch is written, a worker may go on
+   size_t next = 0;                   // next batch to format
+   size_t writing = 0;                // next batch to write
+
+   // Format, and compress, the batch IX
+   auto produce = [&](batch& result, size_t ix)
+   {
+      for (size_t jx = ix * BATCH_SIZE; jx < ids.size() && jx < (ix + 1) * BATCH_SIZE; ++jx)
+         FormatRecord(result.text, ids[jx], Coverage[ ids[jx] ]);
+      result.size = result.text.size();
+#if WRITER_ZLIB
+      if (compress)
+      {
+         std::string deflated;
+         result.crc = crc32(0, (const Bytef*)result.text.data(), result.text.size());
+         result.ok = Deflate(result.text, ix + 1 == count, deflated);
+         result.text.swap(deflated);
+      }
+#endif
+   };
+
+   // With one job, the batches are formatted by this thread
+   std::vector< std::thread > workers;
+   for (unsigned job = 0; jobs > 1 && job < jobs; ++job)
+      workers.push_back(std::thread([&]()
+      {
+         for (;;)
+         {
+            size_t ix;
+            {
+               std::unique_lock< std::mutex > lock(mutex);
+               written.wait(lock, [&]() { return next >= count || next < writing + window; });
+               if (next >= count)
+                  break;
+               ix = next++;
+            }
+
+            batch result;
+            produce(result, ix);
+
+            std::lock_guard< std::mutex > lock(mutex);
+            result.done = true;
+            std::swap(batches[ix], result);
+            formatted.notify_all();
+         }
+      }));
+
+   bool ok = true;
+   std::string pending; // formatted, not yet written
+   unsigned long crc = 0;
+   unsigned long long size = 0;
+#if WRITER_ZLIB
+   if (compress)
+   {
+      // gzip header: deflate, no name, no time, Unix
+      static const char header[] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3 };
+      pending.assign(header, sizeof(header));
+      crc = crc32(0, Z_NULL, 0);
+   }
+#endif
+   while (writing < count)
+   {
+      batch& current = batches[writing];
+      if (workers.empty())
+         produce(current, writing);
+      else
+      {
+         std::unique_lock< std::mutex > lock(mutex);
+         formatted.wait(lock, [&]() { return current.done; });
+      }
+
+      ok = ok && current.ok;
+#if WRITER_ZLIB
+      if (compress)
+         crc = crc32_combine(crc, current.crc, current.size);
+#endif
+      size += current.size;
+      if (pending.empty())
+         pending.swap(current.text);
+      else
+         pending += current.text;
+      std::string().swap(current.text);
+#if WRITER_ZLIB
+      if (compress && writing + 1 == count)
+      {
+         // gzip trailer: CRC-32 and size modulo 2^32, little endian
+         for (int shift = 0; shift < 32; shift += 8)
+            pending += (char)(crc >> shift);
+         for (int shift = 0; shift < 32; shift += 8)
+            pending += (char)(size >> shift);
+      }
+#endif
+      if (pending.size() >= WRITE_SIZE || writing + 1 == count)
+      {
+         if (ok && fwrite(pending.data(), 1, pending.size(), file) != pending.size())
+            ok = false;
+         pending.clear();
+      }
+
+      std::lock_guard< std::mutex > lock(mutex);
+      ++writing;
+      written.notify_all();
+   }
+
+   for (size_t ix = 0; ix < workers.size(); ++ix)
+      workers[ix].join();
+
+   if (file == stdout ? fflush(file) != 0 : fclose(file) != 0)
+      ok = false;
+   return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef __WRITER_H_INCLUDED__
+#define __WRITER_H_INCLUDED__
+
+#include "coverage.h"
+
+#include <string>
+
+// ---------------------------------------------------------------------------
+// Append the tracefile record (TN: to end_of_record) of source ID to OUT
+void FormatRecord(std::string& out, SourceId id, const SourceCoverage& coverage);
+
+// ---------------------------------------------------------------------------
+// Write the tracefile of Coverage to FILENAME (- for stdout), the sources
+// in the order of their names. The records are formatted by JOBS threads,
+// and written in large blocks. If COMPRESS, the output is one gzip stream,
+// of which the batches are compressed by the same threads. SOURCES gets the
+// # of sources written. Returns false on error.
+bool WriteTracefile(const std::string& filename, unsigned jobs, bool compress, unsigned& sources);
+
+#endif